@@ -12,6 +12,7 @@ typedef struct Bios {
 Bios init_bios(char const *filename);
 
 uint32_t load_bios(Bios *bios, Addr offset, AddrType type);
+uint64_t bios_hash(Bios *bios);
 
 void destroy_bios(Bios *bios);
 
@@ -0,0 +1,42 @@
+#include <stdint.h>
+#include <string.h>
+
+#ifndef BYTEORDER_H
+#define BYTEORDER_H
+
+// Guest memory is little-endian. These access it with a single native
+// load or store and only swap bytes on big-endian hosts.
+
+static inline uint16_t read_le16(uint8_t const *ptr) {
+  uint16_t val;
+  memcpy(&val, ptr, sizeof val);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  val = __builtin_bswap16(val);
+#endif
+  return val;
+}
+
+static inline uint32_t read_le32(uint8_t const *ptr) {
+  uint32_t val;
+  memcpy(&val, ptr, sizeof val);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  val = __builtin_bswap32(val);
+#endif
+  return val;
+}
+
+static inline void write_le16(uint8_t *ptr, uint16_t val) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  val = __builtin_bswap16(val);
+#endif
+  memcpy(ptr, &val, sizeof val);
+}
+
+static inline void write_le32(uint8_t *ptr, uint32_t val) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+  val = __builtin_bswap32(val);
+#endif
+  memcpy(ptr, &val, sizeof val);
+}
+
+#endif
@@ -0,0 +1,89 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "instruction.h"
+#include "range.h"
+
+#ifndef CODE_CACHE_H
+#define CODE_CACHE_H
+
+typedef struct Cpu Cpu;
+typedef struct DecodedIns DecodedIns;
+
+typedef void (*OpHandler)(Cpu *cpu, DecodedIns const *ins);
+
+// An instruction with its handler resolved and its fields extracted.
+// `imm` is pre-extended the way the handler consumes it: zero-extended
+// for logical immediates, the jump target for J/JAL, the shift amount
+// for SPECIAL and sign-extended everywhere else.
+typedef struct DecodedIns {
+  OpHandler handler;
+  Ins ins;
+  RegIndex rs;
+  RegIndex rt;
+  RegIndex rd;
+  uint32_t imm;
+} DecodedIns;
+
+#define CODE_PAGE_SHIFT 12
+#define CODE_PAGE_SIZE (1 << CODE_PAGE_SHIFT)
+#define CODE_PAGE_INS_COUNT (CODE_PAGE_SIZE / 4)
+
+// RAM mirrors 2MB four times, so only the first 2MB get pages.
+#define CODE_RAM_SIZE (2 * 1024 * 1024)
+#define CODE_RAM_PAGE_COUNT (CODE_RAM_SIZE / CODE_PAGE_SIZE)
+#define CODE_BIOS_PAGE_COUNT ((512 * 1024) / CODE_PAGE_SIZE)
+#define CODE_PAGE_COUNT (CODE_RAM_PAGE_COUNT + CODE_BIOS_PAGE_COUNT)
+
+// A record with a NULL handler hasn't been decoded yet. `generation`
+// is bumped on every invalidation so code compiled from the page can
+// tell when it went stale.
+typedef struct CodePage {
+  DecodedIns ins[CODE_PAGE_INS_COUNT];
+  uint32_t generation;
+} CodePage;
+
+// Pre-decoded instructions keyed by physical PC. Pages are allocated
+// lazily the first time code runs from them; RAM stores drop the
+// record of the word they hit so self-modifying code is re-decoded.
+typedef struct CodeCache {
+  CodePage *pages[CODE_PAGE_COUNT];
+} CodeCache;
+
+CodeCache init_code_cache();
+
+// Returns the index of the code page holding `addr`, or -1 if code
+// at `addr` isn't cacheable.
+static inline int32_t code_page_index(Addr addr) {
+  addr = mask_region(addr);
+
+  if (addr.data < range(RAM).size)
+    return (addr.data & (CODE_RAM_SIZE - 1)) >> CODE_PAGE_SHIFT;
+
+  int32_t offset = range_contains(range(BIOS), addr);
+  if (offset >= 0)
+    return CODE_RAM_PAGE_COUNT + (offset >> CODE_PAGE_SHIFT);
+
+  return -1;
+}
+
+CodePage *code_cache_page(CodeCache *cache, int32_t index);
+DecodedIns *code_cache_lookup(CodeCache *cache, Addr addr);
+
+static inline void code_cache_invalidate(CodeCache *cache, Addr ram_offset) {
+  CodePage *page = cache->pages[(ram_offset.data & (CODE_RAM_SIZE - 1)) >> CODE_PAGE_SHIFT];
+
+  if (page == NULL)
+    return;
+
+  DecodedIns *decoded = &page->ins[(ram_offset.data >> 2) & (CODE_PAGE_INS_COUNT - 1)];
+  if (decoded->handler) {
+    decoded->handler = NULL;
+    page->generation++;
+  }
+}
+
+void code_cache_invalidate_range(CodeCache *cache, Addr ram_offset, uint32_t size);
+void destroy_code_cache(CodeCache *cache);
+
+#endif
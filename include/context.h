@@ -0,0 +1,37 @@
+#include <stdint.h>
+#include <stddef.h>
+
+#include "instruction.h"
+#include "log.h"
+
+#ifndef CONTEXT_H
+#define CONTEXT_H
+
+#define OUTPUT_LOG_LINE_LEN 1000
+#define OUTPUT_LOG_POOL_SIZE 10
+
+typedef uint64_t FlagSet;
+
+typedef struct OutputLogBuffer {
+  char buffer[OUTPUT_LOG_LINE_LEN];
+  size_t pos;
+} OutputLogBuffer;
+
+// The settings and tracing state of one emulator instance. Every Cpu
+// points at its own, so instances can run side by side on different
+// threads.
+typedef struct Context {
+  FlagSet flag_set;
+  Addr current_pc;
+  Ins current_ins;
+  uint8_t logging_pc;
+  char *rom_filename;
+  OutputLogBuffer buffers[OUTPUT_LOG_POOL_SIZE];
+  size_t next_pool_index;
+  Logger logger;
+} Context;
+
+Context init_context();
+void destroy_context(Context *ctx);
+
+#endif
@@ -1,19 +1,50 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "context.h"
 #include "instruction.h"
 #include "shared.h"
 #include "interconnect.h"
 #include "exception.h"
+#include "jit.h"
+#include "hle.h"
 
 #ifndef CPU_H
 #define CPU_H
 
+// PCs at which run_pc_hooks does extra work before the instruction
+// runs, besides the HLE kernel vectors
+#define SIDELOAD_HOOK_PC 0x80030000
+
+#define SR_ISOLATE_CACHE (1 << 16)
+
+// Longest loop, in instructions, considered for idle loop detection
+#define IDLE_LOOP_MAX_INS 16
+
+// Index of the scratch register an empty load delay slot (or a load
+// into $zero) commits to, so committing never needs a branch
+#define LOAD_DELAY_NONE 32
+
+// Every instruction is charged a flat cycle count
+#define CYCLES_PER_INS 1
+
+// The backward branch last taken. If it closes a loop without side
+// effects, `regs` snapshots the state from the previous iteration.
+typedef struct IdleLoop {
+  Addr branch_pc;
+  bool candidate;
+  uint32_t regs[32];
+  uint32_t hi;
+  uint32_t lo;
+  LoadDelaySlot load_delay_slot;
+} IdleLoop;
+
 typedef struct Cpu {
+  Context *ctx;
   Addr pc;
   Addr next_pc;
   Addr current_pc;
-  uint32_t regs[32];
+  uint32_t regs[33];
   Addr bad_v_adr;
   uint32_t sr;
   uint32_t cause;
@@ -26,23 +57,63 @@ typedef struct Cpu {
   bool delay_slot;
   SharedState shared;
   size_t output_log_index;
+  // Code page PC was last fetched from. `fetch_base` is the virtual
+  // address of its first word.
+  Addr fetch_base;
+  CodePage *fetch_page;
+  uint8_t const *fetch_host;
+  Jit jit;
+  IdleLoop idle_loop;
+  Hle hle;
+  // End of the budget of the running cpu_run call, 0 outside of it
+  uint64_t run_end;
+  // Makes cpu_run return after the current instruction or block
+  bool stop_requested;
 } Cpu;
 
-Cpu init_cpu(char const *bios_filename);
-void set_reg(Cpu *cpu, RegIndex index, uint32_t value);
+Cpu init_cpu(Context *ctx, char const *bios_filename);
+OpHandler decode_handler(Ins ins);
+void decode_ins(DecodedIns *decoded, Ins ins);
 void decode_and_execute(Cpu *cpu, Ins ins);
+DecodedIns *fetch_decoded_ins(Cpu *cpu, Addr pc, DecodedIns *uncached);
+bool run_pc_hooks(Cpu *cpu);
+// run_next_ins skips all tracing; run_next_ins_traced honours the
+// PRINT_PC, PRINT_INS and OUTPUT_LOG flags.
 void run_next_ins(Cpu *cpu);
+void run_next_ins_traced(Cpu *cpu);
 void exception(Cpu *cpu, Exception exp);
 
+// Runs until `budget` cycles have elapsed, a peripheral needs syncing or
+// cpu_request_stop is called. Returns the number of cycles executed,
+// which can overshoot the budget by up to one JIT block.
+Cycles cpu_run(Cpu *cpu, Cycles budget);
+
+static inline void cpu_request_stop(Cpu *cpu) {
+  cpu->stop_requested = true;
+}
+
+static inline void set_reg(Cpu *cpu, RegIndex index, uint32_t value) {
+  cpu->regs[index.data] = value;
+  cpu->regs[0] = 0x0;
+}
+
+// The pending slot never targets $zero, so this is two plain stores
 static inline void delayed_load(Cpu *cpu) {
-  set_reg(cpu, cpu->load_delay_slot.index, cpu->load_delay_slot.val);
-  cpu->load_delay_slot = MAKE_LoadDelaySlot(MAKE_RegIndex(0x0), 0x0);
+  cpu->regs[cpu->load_delay_slot.index.data] = cpu->load_delay_slot.val;
+  cpu->load_delay_slot.index.data = LOAD_DELAY_NONE;
 }
 
+// A load replacing a pending load to the same register discards it
 static inline void delayed_load_chain(Cpu *cpu, RegIndex index, uint32_t val) {
-  if (cpu->load_delay_slot.index.data != index.data)
-    set_reg(cpu, cpu->load_delay_slot.index, cpu->load_delay_slot.val);
-  cpu->load_delay_slot = MAKE_LoadDelaySlot(index, val);
+  uint8_t pending = cpu->load_delay_slot.index.data;
+
+  cpu->regs[(pending == index.data) ? LOAD_DELAY_NONE : pending] = cpu->load_delay_slot.val;
+  cpu->load_delay_slot = MAKE_LoadDelaySlot(MAKE_RegIndex(index.data ? index.data : LOAD_DELAY_NONE), val);
+}
+
+static inline bool has_pc_hook(Addr pc) {
+  return pc.data == SIDELOAD_HOOK_PC || pc.data == HLE_A0_PC ||
+    pc.data == HLE_B0_PC || pc.data == HLE_C0_PC;
 }
 
 void destroy_cpu(Cpu *cpu);
@@ -0,0 +1,37 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef DIRTY_H
+#define DIRTY_H
+
+#define DIRTY_PAGE_SHIFT 12
+#define DIRTY_PAGE_SIZE (1 << DIRTY_PAGE_SHIFT)
+// Enough for the 2MB of RAM
+#define DIRTY_MAP_MAX_PAGES 512
+
+// One bit per page of a buffer, set by every write to it and cleared
+// by whoever consumes the changes (the snapshot code). There's a
+// single consumer per buffer.
+typedef struct DirtyMap {
+  uint64_t bits[DIRTY_MAP_MAX_PAGES / 64];
+  uint32_t page_count;
+} DirtyMap;
+
+// Starts out with every page dirty
+DirtyMap init_dirty_map(uint32_t size);
+void mark_dirty_range(DirtyMap *map, uint32_t offset, uint32_t size);
+void mark_all_dirty(DirtyMap *map);
+void clear_dirty(DirtyMap *map);
+// Marks every page dirty in `other` as dirty in `map` too
+void merge_dirty(DirtyMap *map, DirtyMap const *other);
+
+static inline void mark_dirty(DirtyMap *map, uint32_t offset) {
+  uint32_t page = offset >> DIRTY_PAGE_SHIFT;
+  map->bits[page >> 6] |= 1ULL << (page & 63);
+}
+
+static inline bool page_dirty(DirtyMap const *map, uint32_t page) {
+  return map->bits[page >> 6] & (1ULL << (page & 63));
+}
+
+#endif
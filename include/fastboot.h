@@ -0,0 +1,16 @@
+#include <stdint.h>
+
+#include "cpu.h"
+
+#ifndef FASTBOOT_H
+#define FASTBOOT_H
+
+// The BIOS starts the shell well before this
+#define BOOT_MAX_CYCLES (1ULL << 32)
+
+// Leaves the machine where the BIOS is about to jump to the shell, so
+// the next instruction sideloads the ROM. The state is cached in
+// `cache_dir` by BIOS hash and only computed on the first boot.
+void fast_boot(Cpu *cpu, char const *cache_dir);
+
+#endif
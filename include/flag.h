@@ -1,63 +1,71 @@
+#include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
 
+#include "context.h"
 #include "instruction.h"
 #include "log.h"
 
 #ifndef FLAGS_H
 #define FLAGS_H
 
-typedef uint64_t FlagSet;
-
 typedef enum Flag {
   PRINT_PC = 1 << 0,
   PRINT_INS = 1 << 1,
-  OUTPUT_LOG = 1 << 2
+  OUTPUT_LOG = 1 << 2,
+  CPU_JIT = 1 << 3,
+  NO_HLE = 1 << 4,
+  FAST_BOOT = 1 << 5,
+  HEADLESS = 1 << 6,
+  GPU_THREAD = 1 << 7
 } Flag;
 
-FlagSet flag_set;
-Addr current_pc;
-Ins current_ins;
-uint8_t logging_pc;
-char *rom_filename;
+static inline bool get_flag(Context const *ctx, Flag flag) {
+  return ctx->flag_set & flag;
+}
+
+static inline bool tracing_enabled(Context const *ctx) {
+  return ctx->flag_set & (PRINT_PC | PRINT_INS | OUTPUT_LOG);
+}
 
-static inline bool get_flag(Flag flag) {
-  return flag_set & flag;
+static inline void set_flag(Context *ctx, Flag flag) {
+  ctx->flag_set = (ctx->flag_set | flag);
 }
 
-static inline void set_flag(Flag flag) {
-  flag_set = (flag_set | flag);
+static inline void clear_flag(Context *ctx, Flag flag) {
+  ctx->flag_set = (ctx->flag_set & ~flag);
 }
 
-static inline void set_pc(Addr pc) {
-  current_pc = pc;
+static inline void set_pc(Context *ctx, Addr pc) {
+  ctx->current_pc = pc;
 }
 
-static inline void set_ins(Ins ins) {
-  current_ins = ins;
+static inline void set_ins(Context *ctx, Ins ins) {
+  ctx->current_ins = ins;
 }
 
-static inline void set_rom_filename(char const *filename) {
-  rom_filename = calloc(strlen(filename) + 1, 1);
-  strcpy(rom_filename, filename);
+static inline void set_rom_filename(Context *ctx, char const *filename) {
+  free(ctx->rom_filename);
+  ctx->rom_filename = calloc(strlen(filename) + 1, 1);
+  strcpy(ctx->rom_filename, filename);
 }
 
-static inline char *get_rom_filename() {
-  return rom_filename;
+static inline char *get_rom_filename(Context const *ctx) {
+  return ctx->rom_filename;
 }
 
-#define LOG_PC() \
-  log_trace("PC: 0x%08X", current_pc)
+#define LOG_PC(ctx) \
+  log_trace("PC: 0x%08X", (ctx)->current_pc)
 
-#define START_LOGGING_PC() \
-  if (get_flag(PRINT_PC)) \
-    logging_pc = 1
+#define START_LOGGING_PC(ctx) \
+  if (get_flag(ctx, PRINT_PC)) \
+    (ctx)->logging_pc = 1
 
-#define STOP_LOGGING_PC() \
-  if (get_flag(PRINT_PC)) \
-    logging_pc = 0
+#define STOP_LOGGING_PC(ctx) \
+  if (get_flag(ctx, PRINT_PC)) \
+    (ctx)->logging_pc = 0
 
-#define LOG_INS() \
-  log_ins(current_ins)
+#define LOG_INS(ctx) \
+  log_ins((ctx)->current_ins)
 
 #endif
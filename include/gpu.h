@@ -2,7 +2,9 @@
 #include <stdbool.h>
 #include <SDL2/SDL.h>
 
+#include "context.h"
 #include "dma.h"
+#include "dirty.h"
 #include "instruction.h"
 
 #ifndef GPU_H
@@ -164,7 +166,12 @@ typedef enum GpuRenderMode {
   GpuRenderRect
 } GpuRenderMode;
 
+typedef struct RasterKernels RasterKernels;
+
+// Primitives are drawn into `vram`. Headless renderers have no window,
+// and the SDL fields are NULL.
 typedef struct GpuRenderer {
+  uint16_t *vram;
   SDL_Window *window;
   SDL_Surface *window_surface;
   SDL_Surface *vram_surface;
@@ -176,16 +183,33 @@ typedef struct GpuRenderer {
   Vec2 rect_size;
   Vec3 rect_color;
   Vec2 rect_tex;
+  // Indexed by byte offset into VRAM, so a page is two rows
+  DirtyMap vram_dirty;
+  // Span drawing routines picked for the host CPU
+  RasterKernels const *kernels;
 } GpuRenderer;
 
-GpuRenderer init_renderer();
+#define VRAM_WIDTH 1024
+#define VRAM_HEIGHT 512
+
+GpuRenderer init_renderer(bool headless);
 void renderer_update_window(GpuRenderer *renderer);
 
+// The whole of VRAM as one block, VRAM_WIDTH pixels per row
+static inline uint16_t *vram_pixels(GpuRenderer *renderer) {
+  return renderer->vram;
+}
+
+// Marks rows [top, bottom) as written
+static inline void mark_vram_rows(GpuRenderer *renderer, uint32_t top, uint32_t bottom) {
+  if (bottom > VRAM_HEIGHT)
+    bottom = VRAM_HEIGHT;
+  if (top < bottom)
+    mark_dirty_range(&renderer->vram_dirty, top * VRAM_WIDTH * sizeof(uint16_t), (bottom - top) * VRAM_WIDTH * sizeof(uint16_t));
+}
+
 static inline uint16_t *get_vram(GpuRenderer *renderer, uint16_t x, uint16_t y) {
-  SDL_Surface *surface = renderer->vram_surface;
-  uint16_t *target = surface->pixels;
-  target += (y * surface->pitch + x * surface->format->BytesPerPixel) / 2;
-  return target;
+  return renderer->vram + y * VRAM_WIDTH + x;
 }
 
 void destroy_renderer(GpuRenderer *renderer);
@@ -200,6 +224,8 @@ typedef struct GpuImageBuffer {
 } GpuImageBuffer;
 
 static inline void push_image_word(GpuImageBuffer *buffer, GpuRenderer *renderer, uint32_t image_word) {
+  mark_vram_rows(renderer, buffer->y, buffer->y + 2);
+
   uint16_t *target = get_vram(renderer, buffer->x, buffer->y);
   *target = image_word;
 
@@ -241,11 +267,52 @@ static inline void pop_image_word(GpuImageBuffer *buffer, GpuRenderer *renderer,
   *store = w1 | (w2 << 16);
 }
 
-static inline float edge_func(Vec2 a, Vec2 b, Vec2 c) {
+static inline int32_t edge_func(Vec2 a, Vec2 b, Vec2 c) {
   return (c[0] - a[0]) * (b[1] - a[1]) - (c[1] - a[1]) * (b[0] - a[0]);
 }
 
+// Edge function of a -> b, stepped per pixel and per row. Pixels on
+// edges that aren't top or left edges are biased below zero so they
+// fail the coverage test, like the PSX fill rule.
+typedef struct EdgeStep {
+  int32_t dx;
+  int32_t dy;
+  int32_t row;
+} EdgeStep;
+
+// A per-vertex attribute in 16.16 fixed point, stepped per pixel and
+// per row. The arithmetic wraps, which only matters outside the
+// triangle where the values are never used.
+typedef struct AttrStep {
+  uint32_t dx;
+  uint32_t dy;
+  uint32_t row;
+} AttrStep;
+
+// A primitive with the drawing offset applied and its bounding box
+// clipped, ready to be drawn a part at a time. The box is inclusive.
+typedef struct GpuPrim {
+  GpuRenderMode render_mode;
+  int32_t left;
+  int32_t top;
+  int32_t right;
+  int32_t bottom;
+  // Triangles, stepped from (left, top)
+  EdgeStep edges[3];
+  AttrStep attrs[5];
+  // Rects, with the texel at (left, top)
+  uint16_t color;
+  int32_t u;
+  int32_t v;
+} GpuPrim;
+
+// The PSX skips polygons with an edge longer than this
+#define MAX_TRI_WIDTH 1023
+#define MAX_TRI_HEIGHT 511
+
 typedef void (*GP0Method)(Gpu *gpu, uint32_t val);
+typedef struct GpuThread GpuThread;
+typedef struct GpuTiles GpuTiles;
 
 typedef struct Gpu {
   uint16_t texture_page[2];
@@ -294,6 +361,12 @@ typedef struct Gpu {
   GpuRenderer renderer;
   uint32_t read_word;
   size_t output_log_index;
+  Context *ctx;
+  // Runs GP0 commands when set, see gpu_start_thread
+  GpuThread *thread;
+  // Bins primitives for the tile workers when set. Only used by the
+  // render thread.
+  GpuTiles *tiles;
 } Gpu;
 
 static inline void set_clut(Gpu *gpu, uint32_t val) {
@@ -355,12 +428,33 @@ static inline uint16_t get_texel(Gpu *gpu, uint16_t x, uint16_t y, GpuTextureDep
   return bgr_to_rgb(*get_vram(&gpu->renderer, gpu->clut[0] + index, gpu->clut[1]));
 }
 
-Gpu init_gpu();
+Gpu init_gpu(Context *ctx);
 uint32_t gpu_status(Gpu *gpu);
 uint32_t gpu_read(Gpu *gpu);
 void gpu_gp0(Gpu *gpu, uint32_t val);
+void gpu_execute_gp0(Gpu *gpu, uint32_t val);
+// Recovers gp0_method for a command that was in flight when the state was saved
+void gpu_restore_gp0_method(Gpu *gpu);
 void gpu_gp1(Gpu *gpu, uint32_t val);
+// Fills `prim` from the renderer, false if nothing would be drawn
+bool gpu_setup_prim(Gpu *gpu, GpuPrim *prim);
+// Draws the part of `prim` inside the inclusive box
+void gpu_draw_prim(Gpu *gpu, GpuPrim const *prim, int32_t left, int32_t top, int32_t right, int32_t bottom);
+// Draws `prim` now, or bins it when there are tile workers
+void gpu_submit_prim(Gpu *gpu, GpuPrim const *prim);
 void gpu_draw(Gpu *gpu);
+// Moves GP0 command execution to a render thread. With `workers`, it
+// also bins primitives into tiles that the workers draw in parallel.
+// `gpu` mustn't move until gpu_stop_thread.
+void gpu_start_thread(Gpu *gpu, uint32_t workers);
+void gpu_stop_thread(Gpu *gpu);
+// Draws every binned primitive. Only called on the render thread.
+void gpu_flush(Gpu *gpu);
+// Waits for the render thread to finish every pushed command. Needed
+// before reading or overwriting anything GP0 commands write.
+void gpu_sync(Gpu *gpu);
+// Shows VRAM in the window
+void gpu_present(Gpu *gpu);
 void destroy_gpu(Gpu *gpu);
 
 #endif
@@ -0,0 +1,50 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "gpu.h"
+
+#ifndef GPU_THREAD_H
+#define GPU_THREAD_H
+
+// GP0 words, a power of two
+#define GPU_THREAD_RING_SIZE (64 * 1024)
+#define GPU_THREAD_RING_MASK (GPU_THREAD_RING_SIZE - 1)
+
+// Runs GP0 commands on a render thread. The CPU thread is the only
+// producer and the render thread the only consumer, so pushing a word
+// is a store and an index bump. The mutex and the condition variables
+// are only used to sleep, when the ring is empty or full or when the
+// CPU thread has to wait for the GPU to catch up.
+//
+// `tail` counts the words taken out of the ring. `done` trails it while
+// the tiles hold primitives that haven't been drawn yet.
+typedef struct GpuThread {
+  Gpu *gpu;
+  uint32_t ring[GPU_THREAD_RING_SIZE];
+
+  // Written by the CPU thread
+  _Atomic uint32_t head;
+  _Atomic bool producer_waiting;
+  _Atomic bool quit;
+
+  // Written by the render thread
+  _Atomic uint32_t tail;
+  _Atomic uint32_t done;
+  _Atomic bool consumer_waiting;
+
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  pthread_cond_t progress;
+  pthread_t thread;
+} GpuThread;
+
+// `gpu` mustn't move while the thread runs
+GpuThread *init_gpu_thread(Gpu *gpu);
+void gpu_thread_push(GpuThread *thread, uint32_t word);
+// Waits until every pushed word has been executed and drawn
+void gpu_thread_sync(GpuThread *thread);
+void destroy_gpu_thread(GpuThread *thread);
+
+#endif
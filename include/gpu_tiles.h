@@ -0,0 +1,80 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "gpu.h"
+
+#ifndef GPU_TILES_H
+#define GPU_TILES_H
+
+// Tiles are blocks of VRAM, so the grid stays put when the drawing
+// area moves between frames. Wide tiles keep the spans long.
+#define GPU_TILE_WIDTH 128
+#define GPU_TILE_HEIGHT 32
+#define GPU_TILE_COLUMNS (VRAM_WIDTH / GPU_TILE_WIDTH)
+#define GPU_TILE_ROWS (VRAM_HEIGHT / GPU_TILE_HEIGHT)
+#define GPU_TILE_COUNT (GPU_TILE_COLUMNS * GPU_TILE_ROWS)
+// Primitives binned before the tiles are drawn
+#define GPU_TILE_MAX_PRIMS 1024
+#define GPU_TILE_MAX_WORKERS 64
+
+// An inclusive box of VRAM pixels
+typedef struct GpuArea {
+  int32_t left;
+  int32_t top;
+  int32_t right;
+  int32_t bottom;
+} GpuArea;
+
+// One bit per tile, a row of tiles per word
+typedef uint32_t GpuTileMap[GPU_TILE_ROWS];
+
+// A binned primitive and the GPU state to draw it with
+typedef struct GpuTilePrim {
+  Gpu gpu;
+  GpuPrim prim;
+} GpuTilePrim;
+
+// Primitives are binned into every tile their box touches, in order.
+// A flush hands the tiles out to the workers and the render thread,
+// each drawing whole tiles, so every pixel still sees its primitives
+// in order. Textured primitives that read what the batch draws, or
+// draw over what it reads, flush it first.
+typedef struct GpuTiles {
+  // Owned by the render thread outside of a flush
+  GpuTilePrim *prims;
+  uint32_t prim_count;
+  uint16_t *bins;
+  uint16_t bin_counts[GPU_TILE_COUNT];
+  uint16_t used[GPU_TILE_COUNT];
+  uint32_t used_count;
+  GpuTileMap written;
+  GpuTileMap read;
+
+  // Hands out `used` during a flush
+  _Atomic uint32_t next_tile;
+
+  // Guards the flush handshake
+  uint32_t generation;
+  uint32_t busy;
+  bool quit;
+  pthread_mutex_t lock;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  uint32_t worker_count;
+  pthread_t workers[GPU_TILE_MAX_WORKERS];
+} GpuTiles;
+
+GpuTiles *init_gpu_tiles(uint32_t workers);
+// Bins `prim`, drawn with the current state of `gpu`
+void gpu_tiles_bin(GpuTiles *tiles, Gpu *gpu, GpuPrim const *prim);
+// Draws every binned primitive and empties the bins
+void gpu_tiles_flush(GpuTiles *tiles);
+void destroy_gpu_tiles(GpuTiles *tiles);
+
+static inline bool gpu_tiles_empty(GpuTiles const *tiles) {
+  return tiles->prim_count == 0;
+}
+
+#endif
@@ -0,0 +1,39 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifndef HLE_H
+#define HLE_H
+
+typedef struct Cpu Cpu;
+
+// Kernel calls jump to one of these with the function number in $t1
+#define HLE_A0_PC 0xA0
+#define HLE_B0_PC 0xB0
+#define HLE_C0_PC 0xC0
+
+typedef enum HleVector {
+  HleA0,
+  HleB0,
+  HleC0,
+  HLE_VECTOR_COUNT
+} HleVector;
+
+#define HLE_FUNC_COUNT 256
+
+// Which kernel functions run natively. Functions that only touch their
+// arguments are enabled by default; the ones that stub out kernel state
+// (file I/O, events, threads) have to be opted into.
+typedef struct Hle {
+  bool enabled[HLE_VECTOR_COUNT][HLE_FUNC_COUNT];
+  uint32_t next_event;
+  uint32_t next_thread;
+} Hle;
+
+Hle init_hle();
+void hle_set_enabled(Hle *hle, HleVector vector, uint8_t func, bool enabled);
+void hle_disable_all(Hle *hle);
+// Runs the kernel function being called and returns to $ra. Returns
+// false, leaving the CPU untouched, if the function isn't handled.
+bool hle_call(Cpu *cpu, HleVector vector);
+
+#endif
@@ -0,0 +1,37 @@
+#include <stdint.h>
+
+#include "instruction.h"
+#include "code_cache.h"
+
+#ifndef ICACHE_H
+#define ICACHE_H
+
+#define ICACHE_LINE_COUNT 256
+#define ICACHE_LINE_WORDS 4
+
+// Bits of the cache control register at 0xFFFE0130
+#define CACHE_CONTROL_TAG_TEST (1 << 2)
+#define CACHE_CONTROL_ICACHE_ENABLE (1 << 11)
+
+// `tag` is the masked address of the first word of the line and bit N
+// of `valid` is set when word N holds the instruction at tag + 4 * N.
+typedef struct ICacheLine {
+  uint32_t tag;
+  uint8_t valid;
+  uint32_t data[ICACHE_LINE_WORDS];
+} ICacheLine;
+
+// The 4KB instruction cache. Fetches are served by the CodeCache, so
+// lines are only filled when an instruction gets decoded; what matters
+// is that software flushing a line also drops the decoded code behind it.
+typedef struct ICache {
+  uint32_t control;
+  ICacheLine lines[ICACHE_LINE_COUNT];
+} ICache;
+
+ICache init_icache();
+void icache_fill(ICache *icache, Addr addr, uint32_t word);
+uint32_t icache_load(ICache *icache, Addr addr, AddrType type);
+void icache_store(ICache *icache, CodeCache *code_cache, Addr addr, uint32_t val);
+
+#endif
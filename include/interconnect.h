@@ -1,28 +1,45 @@
 #include "bios.h"
+#include "context.h"
 #include "ram.h"
 #include "dma.h"
 #include "gpu.h"
 #include "timer.h"
 #include "scratch.h"
 #include "shared.h"
+#include "code_cache.h"
+#include "icache.h"
 #include "instruction.h"
 
 #ifndef INTERCONNECT_H
 #define INTERCONNECT_H
 
+#define MEM_PAGE_SHIFT 12
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_SHIFT)
+// Pages covering the physical address space left by mask_region.
+// KSEG2 isn't masked and always takes the slow path.
+#define MEM_PAGE_COUNT (0x20000000 >> MEM_PAGE_SHIFT)
+
 typedef struct Interconnect {
+  Context *ctx;
   Bios bios;
   Ram ram;
   Dma dma;
   Gpu gpu;
   Timers timers;
   Scratchpad pad;
+  CodeCache code_cache;
+  ICache icache;
+  // Host memory backing each page, or NULL if accesses to the page
+  // have to go through the MMIO handlers
+  uint8_t **read_pages;
+  uint8_t **write_pages;
   size_t output_log_index;
 } Interconnect;
 
-Interconnect init_interconnect(char const *bios_filename);
+Interconnect init_interconnect(Context *ctx, char const *bios_filename);
 uint32_t load(Interconnect *inter, SharedState *shared, Addr addr, AddrType type);
 void store(Interconnect *inter, SharedState *shared, Addr addr, uint32_t val, AddrType type);
+uint8_t const *code_page_host_ptr(Interconnect *inter, int32_t index);
 uint32_t get_dma_reg(Interconnect *inter, Addr offset);
 void set_dma_reg(Interconnect *inter, Addr offset, uint32_t val);
 void perform_dma(Interconnect *inter, DmaPort port);
@@ -0,0 +1,43 @@
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "instruction.h"
+#include "code_cache.h"
+
+#ifndef JIT_H
+#define JIT_H
+
+#define JIT_BUFFER_SIZE (32 * 1024 * 1024)
+#define JIT_MAX_BLOCK_INS 64
+// Worst case size of a single translated instruction plus the epilogue
+#define JIT_MAX_INS_BYTES 160
+#define JIT_MAX_BLOCK_BYTES (JIT_MAX_BLOCK_INS * JIT_MAX_INS_BYTES + 64)
+
+typedef void (*JitBlockFn)(Cpu *cpu);
+
+// Native code for the run of instructions starting at `start_pc`.
+// Blocks are keyed by physical PC like the CodeCache, but the code
+// bakes in virtual PCs, so a block is only reused for the same alias
+// and the same generation of its code page.
+typedef struct JitBlock {
+  JitBlockFn code;
+  Addr start_pc;
+  uint32_t generation;
+} JitBlock;
+
+typedef struct JitPage {
+  JitBlock blocks[CODE_PAGE_INS_COUNT];
+} JitPage;
+
+typedef struct Jit {
+  uint8_t *buffer;
+  size_t used;
+  JitPage *pages[CODE_PAGE_COUNT];
+} Jit;
+
+Jit init_jit();
+bool jit_supported();
+void run_next_block(Cpu *cpu);
+void destroy_jit(Jit *jit);
+
+#endif
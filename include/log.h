@@ -28,6 +28,22 @@ typedef struct {
 typedef void (*log_LogFn)(log_Event *ev);
 typedef void (*log_LockFn)(bool lock, void *udata);
 
+#define MAX_CALLBACKS 32
+
+typedef struct {
+  log_LogFn fn;
+  void *udata;
+  int level;
+} log_Callback;
+
+typedef struct Logger {
+  void *udata;
+  log_LockFn lock;
+  int level;
+  bool quiet;
+  log_Callback callbacks[MAX_CALLBACKS];
+} Logger;
+
 enum { LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_FATAL };
 
 #define log_trace(...) log_log(LOG_TRACE, __FILE__, __LINE__, __VA_ARGS__)
@@ -43,6 +59,8 @@ enum { LOG_TRACE, LOG_DEBUG, LOG_INFO, LOG_WARN, LOG_ERROR, LOG_FATAL };
 }
 
 const char* log_level_string(int level);
+Logger init_logger();
+void log_use(Logger *logger);
 void log_set_lock(log_LockFn fn, void *udata);
 void log_set_level(int level);
 void log_set_quiet(bool enable);
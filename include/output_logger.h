@@ -1,26 +1,16 @@
 #include <stdio.h>
 
+#include "context.h"
 #include "flag.h"
 
 #ifndef OUTPUT_LOGGER_H
 #define OUTPUT_LOGGER_H
 
-#define OUTPUT_LOG_LINE_LEN 1000
-#define OUTPUT_LOG_POOL_SIZE 10
+size_t const init_output_log(Context *ctx);
+void print_output_log(Context *ctx, size_t index);
 
-typedef struct OutputLogBuffer {
-  char buffer[OUTPUT_LOG_LINE_LEN];
-  size_t pos;
-} OutputLogBuffer;
-
-extern OutputLogBuffer *buffers;
-static size_t next_pool_index;
-
-size_t const init_output_log();
-void print_output_log(size_t index);
-
-#define LOG_OUTPUT(index, fmt, ...) \
-  if (get_flag(OUTPUT_LOG)) \
-    buffers[index].pos = sprintf(buffers[index].buffer + buffers[index].pos, fmt, __VA_ARGS__) 
+#define LOG_OUTPUT(ctx, index, fmt, ...) \
+  if (get_flag(ctx, OUTPUT_LOG)) \
+    (ctx)->buffers[index].pos = sprintf((ctx)->buffers[index].buffer + (ctx)->buffers[index].pos, fmt, __VA_ARGS__) 
 
 #endif
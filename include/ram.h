@@ -1,15 +1,25 @@
 #include <stdint.h>
+#include <stdbool.h>
 
 #include "range.h"
+#include "dirty.h"
 
 #ifndef RAM_H
 #define RAM_H
 
+#define RAM_PHYSICAL_SIZE (2 * 1024 * 1024)
+
+// When `mirrored` is set, `data` spans the whole RAM range with the
+// 2MB of physical memory mapped at every mirror. Otherwise it only
+// holds the physical 2MB. `dirty` is indexed by physical offset.
 typedef struct Ram {
   uint8_t *data;
+  bool mirrored;
+  DirtyMap dirty;
 } Ram;
 
 Ram init_ram();
+uint8_t *ram_host_ptr(Ram *ram, uint32_t offset);
 uint32_t load_ram(Ram *ram, Addr offset, AddrType type);
 void store_ram(Ram *ram, Addr offset, uint32_t val, AddrType type);
 void destroy_ram(Ram *ram);
@@ -0,0 +1,75 @@
+#include <stdint.h>
+
+#include "gpu.h"
+
+#ifndef RASTER_H
+#define RASTER_H
+
+// Indices into the per-pixel values of a TriSpan
+typedef enum TriSpanValue {
+  SpanW0,
+  SpanW1,
+  SpanW2,
+  SpanR,
+  SpanG,
+  SpanB,
+  SpanU,
+  SpanV,
+  SpanValueCount
+} TriSpanValue;
+
+// `count` pixels of one triangle row starting at `target`. `value` holds
+// the three edge functions and the 16.16 attributes at the first pixel,
+// `dx` what they change by per pixel. All of them wrap like vector lanes.
+typedef struct TriSpan {
+  uint16_t *target;
+  int32_t count;
+  uint32_t value[SpanValueCount];
+  uint32_t dx[SpanValueCount];
+} TriSpan;
+
+// `count` pixels of one rect row starting at `target`. Textured rects
+// read texels from (u, v) onwards, the others fill with `color`.
+typedef struct RectSpan {
+  uint16_t *target;
+  int32_t count;
+  uint16_t color;
+  uint16_t u;
+  uint16_t v;
+} RectSpan;
+
+typedef struct RasterKernels {
+  char const *name;
+  void (*tri_span)(Gpu *gpu, TriSpan const *span);
+  void (*rect_span)(Gpu *gpu, RectSpan const *span);
+} RasterKernels;
+
+static inline bool span_covered(uint32_t const value[SpanValueCount]) {
+  return (int32_t)(value[SpanW0] | value[SpanW1] | value[SpanW2]) >= 0;
+}
+
+// 16.16 attribute to an integer, clamping the rounding error below 0
+static inline int32_t attr_value(uint32_t value) {
+  int32_t v = (int32_t)value >> 16;
+  return v < 0 ? 0 : v;
+}
+
+static inline void advance_tri_span(TriSpan *span, int32_t pixels) {
+  for (int k = 0; k < SpanValueCount; k++)
+    span->value[k] += span->dx[k] * (uint32_t)pixels;
+  span->target += pixels;
+  span->count -= pixels;
+}
+
+void scalar_tri_span(Gpu *gpu, TriSpan const *span);
+void scalar_rect_span(Gpu *gpu, RectSpan const *span);
+
+#if defined(__x86_64__)
+extern RasterKernels const sse2_kernels;
+extern RasterKernels const avx2_kernels;
+#endif
+
+RasterKernels const *find_raster_kernels(char const *name);
+RasterKernels const *select_raster_kernels();
+
+#endif
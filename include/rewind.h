@@ -0,0 +1,88 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "savestate.h"
+
+#ifndef REWIND_H
+#define REWIND_H
+
+// Captures per second when driven once per frame
+#define REWIND_FPS 60
+#define REWIND_KEYFRAME_INTERVAL 60
+#define REWIND_JOB_COUNT 4
+#define REWIND_DEFAULT_MEMORY_CAP (256 * 1024 * 1024)
+
+// A captured machine state, compressed. Keyframes hold every section;
+// the entries after one hold the pages changed since it, XORed with it.
+typedef struct RewindEntry {
+  uint8_t *data;
+  size_t size;
+  size_t raw_size;
+  bool keyframe;
+} RewindEntry;
+
+// The state changed since the previous job. Paged sections only have
+// the pages set in `pages` filled in.
+typedef struct RewindJob {
+  uint8_t *sections[STATE_SECTION_COUNT];
+  DirtyMap pages[STATE_SECTION_COUNT];
+} RewindJob;
+
+// Keeps the most recent states in a ring. Capturing only copies the
+// changed pages into a job; a worker thread does the delta encoding
+// and compression. If the worker falls behind, captures are dropped
+// rather than stalling emulation.
+//
+// The Snapshot inside takes over the machine's dirty maps, so nothing
+// else can snapshot the same machine.
+typedef struct Rewind {
+  // Owned by the emulation thread
+  Snapshot snapshot;
+  DirtyMap pending[STATE_SECTION_COUNT];
+  uint64_t dropped;
+
+  // Owned by the worker while it runs a job
+  uint8_t *current[STATE_SECTION_COUNT];
+  uint8_t *keyframe[STATE_SECTION_COUNT];
+  DirtyMap since_keyframe[STATE_SECTION_COUNT];
+  uint32_t keyframe_interval;
+  uint32_t since_keyframe_count;
+  bool force_keyframe;
+  uint8_t *payload;
+  size_t payload_capacity;
+  uint8_t *compressed;
+
+  RewindEntry *entries;
+  uint32_t capacity;
+  uint32_t first;
+  uint32_t count;
+  uint32_t keyframe_count;
+  size_t memory_used;
+  size_t memory_cap;
+
+  // Guards the job queue
+  RewindJob jobs[REWIND_JOB_COUNT];
+  uint32_t job_head;
+  uint32_t job_tail;
+  bool busy;
+  bool quit;
+  pthread_mutex_t lock;
+  pthread_cond_t job_ready;
+  pthread_cond_t job_done;
+  pthread_t worker;
+} Rewind;
+
+// Initialised in place, since the worker holds on to `rewind`.
+// `memory_cap` bounds the compressed entries.
+void init_rewind(Rewind *rewind, Cpu *cpu, uint32_t capacity, size_t memory_cap);
+void rewind_capture(Rewind *rewind, Cpu *cpu);
+// Number of states that can be rewound to, once pending captures are done
+uint32_t rewind_count(Rewind *rewind);
+// Restores the state captured `steps` captures before the latest one and
+// forgets everything after it
+bool rewind_restore(Rewind *rewind, Cpu *cpu, uint32_t steps);
+void destroy_rewind(Rewind *rewind);
+
+#endif
@@ -0,0 +1,25 @@
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#ifndef RLE_H
+#define RLE_H
+
+// Control bytes below 0x80 start a literal of (c + 1) bytes. The rest
+// start a run of ((c & 0x7F) << 8 | next) + RLE_MIN_RUN copies of the
+// byte after that, so a zeroed 4KB page takes 3 bytes.
+#define RLE_MAX_LITERAL 128
+#define RLE_MIN_RUN 3
+#define RLE_MAX_RUN (0x7FFF + RLE_MIN_RUN)
+
+// Worst case compressed size, all literals
+static inline size_t rle_bound(size_t size) {
+  return size + (size + RLE_MAX_LITERAL - 1) / RLE_MAX_LITERAL;
+}
+
+// `dst` has to hold rle_bound(size) bytes. Returns the compressed size.
+size_t rle_compress(uint8_t const *src, size_t size, uint8_t *dst);
+// Fails unless `src` decodes to exactly `dst_size` bytes
+bool rle_decompress(uint8_t const *src, size_t size, uint8_t *dst, size_t dst_size);
+
+#endif
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "cpu.h"
+
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+// Bump whenever a section's layout changes
+#define STATE_VERSION 2
+
+#define STATE_TAG(a, b, c, d) \
+  ((uint32_t)(a) | ((uint32_t)(b) << 8) | ((uint32_t)(c) << 16) | ((uint32_t)(d) << 24))
+
+// A state file is a StateHeader followed by `section_count` sections,
+// each a StateSectionHeader and `size` bytes of payload. Headers and
+// machine state are stored field by field as little-endian values of a
+// fixed width. RAM and VRAM are single sections, so restoring them is
+// one read each.
+typedef struct StateHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t section_count;
+  // States only load on a machine running the same BIOS image
+  uint64_t bios_hash;
+} StateHeader;
+
+#define STATE_HEADER_SIZE 24
+
+typedef struct StateSectionHeader {
+  uint32_t tag;
+  uint32_t reserved;
+  uint64_t size;
+} StateSectionHeader;
+
+#define STATE_SECTION_HEADER_SIZE 16
+
+typedef enum StateSectionIndex {
+  StateCpu,
+  StateClock,
+  StateDma,
+  StateGpu,
+  StateTimers,
+  StateICache,
+  StateRam,
+  StateScratchpad,
+  StateVram,
+  STATE_SECTION_COUNT
+} StateSectionIndex;
+
+// An in-memory copy of every section, kept in sync incrementally: RAM,
+// the scratchpad and VRAM only have the pages written since the last
+// update or restore copied. The machine's dirty maps belong to it, so
+// only one snapshot can track a machine.
+typedef struct Snapshot {
+  uint8_t *sections[STATE_SECTION_COUNT];
+  uint64_t sizes[STATE_SECTION_COUNT];
+  // Whether a section is copied a page at a time, and which pages the
+  // last update copied
+  bool paged[STATE_SECTION_COUNT];
+  DirtyMap changed[STATE_SECTION_COUNT];
+} Snapshot;
+
+// Errors are logged and leave the machine untouched
+bool save_state(Cpu *cpu, char const *filename);
+bool load_state(Cpu *cpu, char const *filename);
+// Same as save_state, but writes to (and closes) an open file
+bool write_state(Cpu *cpu, FILE *fp);
+
+Snapshot init_snapshot(Cpu *cpu);
+// Returns the number of pages copied
+uint32_t snapshot_update(Snapshot *snapshot, Cpu *cpu);
+// Rolls the machine back to the last update
+void snapshot_restore(Snapshot *snapshot, Cpu *cpu);
+// Copies the whole snapshot back, for when its sections were changed
+// behind the machine's back
+void snapshot_load(Snapshot *snapshot, Cpu *cpu);
+void destroy_snapshot(Snapshot *snapshot);
+
+#endif
@@ -1,12 +1,14 @@
 #include <stdint.h>
 
 #include "range.h"
+#include "dirty.h"
 
 #ifndef SCRATCHPAD_H
 #define SCRATCHPAD_H
 
 typedef struct Scratchpad {
   uint8_t *data;
+  DirtyMap dirty;
 } Scratchpad;
 
 Scratchpad init_scratchpad();
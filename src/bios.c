@@ -3,6 +3,7 @@
 #include "instruction.h"
 #include "log.h"
 #include "bios.h"
+#include "byteorder.h"
 
 Bios init_bios(char const *filename) {
   Bios bios;
@@ -26,21 +27,11 @@ Bios init_bios(char const *filename) {
 }
 
 uint32_t load_bios32(Bios *bios, Addr offset) {
-
-  uint32_t b0 = bios->data[offset.data++]; 
-  uint32_t b1 = bios->data[offset.data++]; 
-  uint32_t b2 = bios->data[offset.data++]; 
-  uint32_t b3 = bios->data[offset.data++]; 
-
-  return b0 | (b1 << 8) | (b2 << 16) | (b3 << 24);
+  return read_le32(bios->data + offset.data);
 }
 
 uint16_t load_bios16(Bios *bios, Addr offset) {
-
-  uint16_t b0 = bios->data[offset.data++];
-  uint16_t b1 = bios->data[offset.data++];
-
-  return b0 | (b1 << 8);
+  return read_le16(bios->data + offset.data);
 }
 
 uint8_t load_bios8(Bios *bios, Addr offset) {
@@ -58,6 +49,18 @@ uint32_t load_bios(Bios *bios, Addr offset, AddrType type) {
   }
 }
 
+// FNV-1a over the whole image
+uint64_t bios_hash(Bios *bios) {
+  uint64_t hash = 0xCBF29CE484222325ULL;
+
+  for (uint32_t index = 0; index < range(BIOS).size; index++) {
+    hash ^= bios->data[index];
+    hash *= 0x100000001B3ULL;
+  }
+
+  return hash;
+}
+
 void destroy_bios(Bios *bios) {
-  free(bios);
+  free(bios->data);
 }
@@ -4,7 +4,7 @@
 PeripheralClock init_peripheral_clock() {
   PeripheralClock clock;
   clock.last_sync = MAKE_Cycles(0);
-  clock.next_sync = MAKE_Cycles(0);
+  clock.next_sync = MAKE_Cycles(UINT64_MAX);
 
   return clock;
 }
@@ -18,7 +18,7 @@ Cycles sync_peripheral(PeripheralClock *clock, Cycles now) {
 Clock init_clock() {
   Clock clock;
   clock.now = MAKE_Cycles(0);
-  clock.next_sync = MAKE_Cycles(0);
+  clock.next_sync = MAKE_Cycles(UINT64_MAX);
   for(size_t i=0; i<PeripheralCount; i++)
     clock.peripheral_clocks[i] = init_peripheral_clock();
 
@@ -39,4 +39,6 @@ void update_sync_pending(Clock *clock) {
     Cycles cur_next_sync = clock->peripheral_clocks[i].next_sync;
     new_next_sync = (new_next_sync.data > cur_next_sync.data) ? cur_next_sync : new_next_sync;
   }
+
+  clock->next_sync = new_next_sync;
 }
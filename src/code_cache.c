@@ -0,0 +1,50 @@
+#include <stdlib.h>
+
+#include "code_cache.h"
+#include "log.h"
+
+CodeCache init_code_cache() {
+  CodeCache cache;
+
+  for (size_t index = 0; index < CODE_PAGE_COUNT; index++)
+    cache.pages[index] = NULL;
+
+  return cache;
+}
+
+CodePage *code_cache_page(CodeCache *cache, int32_t index) {
+  CodePage *page = cache->pages[index];
+
+  if (page == NULL) {
+    page = calloc(1, sizeof(CodePage));
+    if (page == NULL)
+      fatal("MemoryError: Couldn't allocate code page: %d", index);
+    cache->pages[index] = page;
+  }
+
+  return page;
+}
+
+DecodedIns *code_cache_lookup(CodeCache *cache, Addr addr) {
+  int32_t index = code_page_index(addr);
+  if (index < 0)
+    return NULL;
+
+  CodePage *page = code_cache_page(cache, index);
+
+  return &page->ins[(addr.data >> 2) & (CODE_PAGE_INS_COUNT - 1)];
+}
+
+void code_cache_invalidate_range(CodeCache *cache, Addr ram_offset, uint32_t size) {
+  uint32_t end = ram_offset.data + size;
+
+  for (uint32_t offset = ram_offset.data & ~3; offset < end; offset += 4)
+    code_cache_invalidate(cache, MAKE_Addr(offset));
+}
+
+void destroy_code_cache(CodeCache *cache) {
+  for (size_t index = 0; index < CODE_PAGE_COUNT; index++) {
+    free(cache->pages[index]);
+    cache->pages[index] = NULL;
+  }
+}
@@ -0,0 +1,25 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "context.h"
+
+Context init_context() {
+  Context ctx;
+
+  ctx.flag_set = 0x0;
+  ctx.current_pc = MAKE_Addr(0x0);
+  ctx.current_ins = MAKE_Ins(0x0);
+  ctx.logging_pc = 0;
+  ctx.rom_filename = calloc(1, 1);
+  if (ctx.rom_filename == NULL)
+    fatal("MemoryError: Couldn't allocate context");
+  memset(ctx.buffers, 0, sizeof ctx.buffers);
+  ctx.next_pool_index = 0;
+  ctx.logger = init_logger();
+
+  return ctx;
+}
+
+void destroy_context(Context *ctx) {
+  free(ctx->rom_filename);
+}
@@ -7,6 +7,7 @@
 #include "instruction.h"
 #include "output_logger.h"
 #include "flag.h"
+#include "byteorder.h"
 
 typedef struct RomHeader {
   Addr initial_pc;
@@ -21,16 +22,16 @@ typedef struct RomHeader {
 } RomHeader;
 
 void side_load_rom(Cpu *cpu) {
-  FILE * const fp = fopen(get_rom_filename(), "rb");
+  FILE * const fp = fopen(get_rom_filename(cpu->ctx), "rb");
 
   if (!fp)
-    fatal("IOError: Could not open ROM: %s", rom_filename);
+    fatal("IOError: Could not open ROM: %s", get_rom_filename(cpu->ctx));
 
   RomHeader header;
 
   fseek(fp, 0x10L, SEEK_SET);
   if (fread(&header, sizeof(RomHeader), 1, fp) != 1)
-    fatal("IOError: Invalid ROM Header: %s", rom_filename);
+    fatal("IOError: Invalid ROM Header: %s", get_rom_filename(cpu->ctx));
 
   cpu->next_pc = header.initial_pc;
   cpu->regs[28] = header.initial_r28;
@@ -42,10 +43,18 @@ void side_load_rom(Cpu *cpu) {
   count -= ftell(fp);
 
   if (fread(&cpu->inter.ram.data[header.ram_address.data], sizeof(uint8_t), count, fp) != sizeof(uint8_t) * count)
-    fatal("IOError: Couldn't read ROM data: %s", rom_filename);
+    fatal("IOError: Couldn't read ROM data: %s", get_rom_filename(cpu->ctx));
 
   memset(&cpu->inter.ram.data[header.data_start.data], 0, header.data_size);
   memset(&cpu->inter.ram.data[header.bss_start.data], 0, header.bss_size);
+
+  code_cache_invalidate_range(&cpu->inter.code_cache, header.ram_address, count);
+  code_cache_invalidate_range(&cpu->inter.code_cache, header.data_start, header.data_size);
+  code_cache_invalidate_range(&cpu->inter.code_cache, header.bss_start, header.bss_size);
+  mark_dirty_range(&cpu->inter.ram.dirty, header.ram_address.data, count);
+  mark_dirty_range(&cpu->inter.ram.dirty, header.data_start.data, header.data_size);
+  mark_dirty_range(&cpu->inter.ram.dirty, header.bss_start.data, header.bss_size);
+
   if (header.r29_start.data) {
     cpu->regs[29] = header.r29_start.data + header.r29_size;
     cpu->regs[30] = header.r29_start.data + header.r29_size;
@@ -54,9 +63,13 @@ void side_load_rom(Cpu *cpu) {
   fclose(fp);
 }
 
-Cpu init_cpu(char const *bios_filename) {
+Cpu init_cpu(Context *ctx, char const *bios_filename) {
   Cpu cpu = {0};
 
+  log_use(&ctx->logger);
+
+  cpu.ctx = ctx;
+
   cpu.pc = MAKE_Addr(0xBFC00000);
   cpu.next_pc = MAKE_Addr(cpu.pc.data + 4);
   cpu.current_pc = MAKE_Addr(0x0);
@@ -64,78 +77,198 @@ Cpu init_cpu(char const *bios_filename) {
     cpu.regs[index] = 0xDEADDEAD;
   }
   cpu.regs[0] = 0x0;
+  cpu.regs[LOAD_DELAY_NONE] = 0x0;
   cpu.bad_v_adr = MAKE_Addr(0x0);
   cpu.sr = 0x0;
   cpu.cause = 0x0;
   cpu.epc = MAKE_Addr(0x0);
   cpu.hi = cpu.lo = 0xDEADDEAD;
-  cpu.load_delay_slot = MAKE_LoadDelaySlot(MAKE_RegIndex(0x0), 0x0); 
-  cpu.inter = init_interconnect(bios_filename);
+  cpu.load_delay_slot = MAKE_LoadDelaySlot(MAKE_RegIndex(LOAD_DELAY_NONE), 0x0);
+  cpu.inter = init_interconnect(ctx, bios_filename);
   cpu.branch = false;
   cpu.delay_slot = false;
   cpu.shared = init_shared();
-  cpu.output_log_index = init_output_log();
+  cpu.output_log_index = init_output_log(ctx);
+  cpu.jit = init_jit();
+  cpu.fetch_base = MAKE_Addr(0x0);
+  cpu.fetch_page = NULL;
+  cpu.fetch_host = NULL;
+  cpu.idle_loop.branch_pc = MAKE_Addr(0x0);
+  cpu.idle_loop.candidate = false;
+  cpu.hle = init_hle();
+  cpu.run_end = 0;
+  cpu.stop_requested = false;
 
   return cpu;
 }
 
-void set_reg(Cpu *cpu, RegIndex index, uint32_t value) {
-  cpu->regs[index.data] = value;
-  cpu->regs[0] = 0x0;
+static bool set_fetch_page(Cpu *cpu, Addr pc) {
+  int32_t index = code_page_index(pc);
+
+  if (index < 0) {
+    cpu->fetch_page = NULL;
+    return false;
+  }
+
+  cpu->fetch_base = MAKE_Addr(pc.data & ~(CODE_PAGE_SIZE - 1));
+  cpu->fetch_page = code_cache_page(&cpu->inter.code_cache, index);
+  cpu->fetch_host = code_page_host_ptr(&cpu->inter, index);
+
+  return true;
 }
 
-void run_next_ins(Cpu *cpu) {
+DecodedIns *fetch_decoded_ins(Cpu *cpu, Addr pc, DecodedIns *uncached) {
+  if (cpu->fetch_page == NULL || (pc.data & ~(CODE_PAGE_SIZE - 1)) != cpu->fetch_base.data) {
+    if (!set_fetch_page(cpu, pc)) {
+      decode_ins(uncached, MAKE_Ins(load(&cpu->inter, &cpu->shared, pc, AddrWord)));
+      return uncached;
+    }
+  }
+
+  uint32_t offset = pc.data & (CODE_PAGE_SIZE - 4);
+  DecodedIns *decoded = &cpu->fetch_page->ins[offset >> 2];
+
+  if (decoded->handler == NULL) {
+    uint32_t word = read_le32(cpu->fetch_host + offset);
+    decode_ins(decoded, MAKE_Ins(word));
+    icache_fill(&cpu->inter.icache, pc, word);
+  }
+
+  return decoded;
+}
+
+// Returns true if a hook already moved the CPU on to another PC
+bool run_pc_hooks(Cpu *cpu) {
   // Sideload ROM
-  if (cpu->pc.data == 0x80030000 && strlen(get_rom_filename()))
+  if (cpu->pc.data == SIDELOAD_HOOK_PC && strlen(get_rom_filename(cpu->ctx)))
     side_load_rom(cpu);
 
-  // Intercept Syscalls
-  if (cpu->pc.data == 0xB0) {
-    switch (cpu->regs[9] & 0xFF) {
-      case 0x3B:
-        putchar(cpu->regs[4]);
-        break;
-      case 0x3D:
-        putchar(cpu->regs[4]);
-        break;
-    }
+  switch (cpu->pc.data) {
+    case HLE_A0_PC:
+      return hle_call(cpu, HleA0);
+    case HLE_B0_PC:
+      if (hle_call(cpu, HleB0))
+        return true;
+
+      // Intercept Syscalls
+      switch (cpu->regs[9] & 0xFF) {
+        case 0x3B:
+          putchar(cpu->regs[4]);
+          break;
+        case 0x3D:
+          putchar(cpu->regs[4]);
+          break;
+      }
+      return false;
+    case HLE_C0_PC:
+      return hle_call(cpu, HleC0);
+  }
+
+  return false;
+}
+
+static inline void advance_pc(Cpu *cpu) {
+  tick(&cpu->shared.clock, MAKE_Cycles(CYCLES_PER_INS));
+
+  // Increment PC
+  cpu->pc = cpu->next_pc;
+  cpu->next_pc = MAKE_Addr(cpu->next_pc.data + 4);
+
+  // Check if in delay_slot
+  cpu->delay_slot = cpu->branch;
+  cpu->branch = false;
+}
+
+void run_next_ins(Cpu *cpu) {
+  if (run_pc_hooks(cpu))
+    return;
+
+  // Fetch the instruction
+  DecodedIns uncached;
+  DecodedIns const *decoded = fetch_decoded_ins(cpu, cpu->pc, &uncached);
+  cpu->current_pc = cpu->pc;
+
+  if (cpu->current_pc.data % 4) {
+    exception(cpu, LoadAddressError);
+    return;
   }
 
+  advance_pc(cpu);
+
+  // Execute current instruction
+  decoded->handler(cpu, decoded);
+}
+
+void run_next_ins_traced(Cpu *cpu) {
+  if (run_pc_hooks(cpu))
+    return;
+
   // Fetch the instruction
-  Ins ins = MAKE_Ins(load(&cpu->inter, &cpu->shared, cpu->pc, AddrWord));
+  DecodedIns uncached;
+  DecodedIns const *decoded = fetch_decoded_ins(cpu, cpu->pc, &uncached);
+  Ins ins = decoded->ins;
   cpu->current_pc = cpu->pc;
 
-  set_pc(cpu->current_pc);
-  set_ins(ins);
-  if (logging_pc) {
-    LOG_PC();
+  set_pc(cpu->ctx, cpu->current_pc);
+  set_ins(cpu->ctx, ins);
+  if (cpu->ctx->logging_pc) {
+    LOG_PC(cpu->ctx);
   }
   char const *func_name = funcs[get_func(ins)];
   if (strcmp(func_name, "") == 0)
     func_name = special_funcs[get_sub_func(ins)];
 
-  LOG_OUTPUT(cpu->output_log_index, "%08x %08x: %s", cpu->current_pc.data, ins.data, func_name);
+  LOG_OUTPUT(cpu->ctx, cpu->output_log_index, "%08x %08x: %s", cpu->current_pc.data, ins.data, func_name);
 
   if (cpu->current_pc.data % 4) {
     exception(cpu, LoadAddressError);
     return;
   }
 
-  // Increment PC
-  cpu->pc = cpu->next_pc;
-  cpu->next_pc = MAKE_Addr(cpu->next_pc.data + 4);
-
-  // Check if in delay_slot
-  cpu->delay_slot = cpu->branch;
-  cpu->branch = false;
+  advance_pc(cpu);
 
-  if (get_flag(PRINT_INS))
+  if (get_flag(cpu->ctx, PRINT_INS))
     log_ins(ins);
 
   // Execute current instruction
-  decode_and_execute(cpu, ins);
+  decoded->handler(cpu, decoded);
 
-  print_output_log(cpu->output_log_index);
+  print_output_log(cpu->ctx, cpu->output_log_index);
+}
+
+// `step` is always a constant, so each call site gets its own loop
+static inline void run_until(Cpu *cpu, uint64_t limit, void (*step)(Cpu *)) {
+  while (cpu->shared.clock.now.data < limit && !cpu->stop_requested)
+    step(cpu);
+}
+
+Cycles cpu_run(Cpu *cpu, Cycles budget) {
+  Clock *clock = &cpu->shared.clock;
+  Cycles start = clock->now;
+  uint64_t end = (budget.data > UINT64_MAX - start.data) ? UINT64_MAX : start.data + budget.data;
+  cpu->run_end = end;
+  log_use(&cpu->ctx->logger);
+
+  while (clock->now.data < end && !cpu->stop_requested) {
+    uint64_t limit = (clock->next_sync.data < end) ? clock->next_sync.data : end;
+
+    if (get_flag(cpu->ctx, CPU_JIT))
+      run_until(cpu, limit, run_next_block);
+    else if (tracing_enabled(cpu->ctx))
+      run_until(cpu, limit, run_next_ins_traced);
+    else
+      run_until(cpu, limit, run_next_ins);
+
+    if (sync_pending(clock)) {
+      interconnect_sync(&cpu->inter, &cpu->shared);
+      break;
+    }
+  }
+
+  cpu->stop_requested = false;
+  cpu->run_end = 0;
+
+  return MAKE_Cycles(clock->now.data - start.data);
 }
 
 void exception(Cpu *cpu, Exception exp) {
@@ -161,27 +294,48 @@ void exception(Cpu *cpu, Exception exp) {
   cpu->next_pc = MAKE_Addr(cpu->pc.data + 4);
 }
 
+static void check_idle_loop(Cpu *cpu, Addr target);
+
 void branch(Cpu *cpu, uint32_t offset) {
   offset = offset << 2;
 
   cpu->next_pc = MAKE_Addr(cpu->pc.data + offset);
 
   cpu->branch = true;
+
+  if (cpu->next_pc.data <= cpu->current_pc.data)
+    check_idle_loop(cpu, cpu->next_pc);
 }
 
-void op_lui(Cpu *cpu, Ins ins) {
-  uint32_t imm = get_imm(ins);
-  RegIndex rt = get_rt(ins);
+// With the cache isolated (SR bit 16) data accesses hit the I-cache
+// instead of memory. The BIOS relies on this to flush the cache.
+static inline uint32_t cpu_load(Cpu *cpu, Addr addr, AddrType type) {
+  if (cpu->sr & SR_ISOLATE_CACHE)
+    return icache_load(&cpu->inter.icache, addr, type);
+
+  return load(&cpu->inter, &cpu->shared, addr, type);
+}
+
+static inline void cpu_store(Cpu *cpu, Addr addr, uint32_t val, AddrType type) {
+  if (cpu->sr & SR_ISOLATE_CACHE)
+    icache_store(&cpu->inter.icache, &cpu->inter.code_cache, addr, val);
+  else
+    store(&cpu->inter, &cpu->shared, addr, val, type);
+}
+
+void op_lui(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm = ins->imm;
+  RegIndex rt = ins->rt;
 
   delayed_load(cpu);
 
   set_reg(cpu, rt, imm << 16);
 }
 
-void op_ori(Cpu *cpu, Ins ins) {
-  uint32_t imm = get_imm(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_ori(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   uint32_t reg_s = cpu->regs[rs.data];
 
   delayed_load(cpu);
@@ -189,10 +343,10 @@ void op_ori(Cpu *cpu, Ins ins) {
   set_reg(cpu, rt, imm | reg_s);
 }
 
-void op_xori(Cpu *cpu, Ins ins) {
-  uint32_t imm = get_imm(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_xori(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   uint32_t reg_s = cpu->regs[rs.data];
 
   delayed_load(cpu);
@@ -200,10 +354,10 @@ void op_xori(Cpu *cpu, Ins ins) {
   set_reg(cpu, rt, imm ^ reg_s);
 }
 
-void op_andi(Cpu *cpu, Ins ins) {
-  uint32_t imm = get_imm(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_andi(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   uint32_t reg_s = cpu->regs[rs.data];
 
   delayed_load(cpu);
@@ -211,15 +365,10 @@ void op_andi(Cpu *cpu, Ins ins) {
   set_reg(cpu, rt, imm & reg_s);
 }
 
-void op_sw(Cpu *cpu, Ins ins) {
-  if (cpu->sr & 0x10000) {
-    log_info("Ignoring store calls while cache is isolated");
-    return;
-  }
-
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_sw(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   Addr addr = MAKE_Addr(imm_se + cpu->regs[rs.data]);
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -230,15 +379,15 @@ void op_sw(Cpu *cpu, Ins ins) {
     return;
   }
 
-  LOG_OUTPUT(cpu->output_log_index, " Addr: 0x%08X, Value: 0x%08X", addr.data, reg_t);
+  LOG_OUTPUT(cpu->ctx, cpu->output_log_index, " Addr: 0x%08X, Value: 0x%08X", addr.data, reg_t);
 
-  store(&cpu->inter, &cpu->shared, addr, reg_t, AddrWord);
+  cpu_store(cpu, addr, reg_t, AddrWord);
 }
 
-void op_sll(Cpu *cpu, Ins ins) {
-  uint32_t shift = get_shift(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_sll(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t shift = ins->imm;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t reg_t = cpu->regs[rt.data];
 
   delayed_load(cpu);
@@ -246,10 +395,10 @@ void op_sll(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_t << shift);
 }
 
-void op_sllv(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_sllv(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t reg_s = cpu->regs[rs.data];
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -258,10 +407,10 @@ void op_sllv(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_t << (reg_s & 0x1F));
 }
 
-void op_addiu(Cpu *cpu, Ins ins) {
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_addiu(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   uint32_t reg_s = cpu->regs[rs.data];
 
   delayed_load(cpu);
@@ -269,10 +418,10 @@ void op_addiu(Cpu *cpu, Ins ins) {
   set_reg(cpu, rt, reg_s + imm_se);
 }
 
-void op_addi(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  uint32_t imm_se = get_imm_se(ins);
+void op_addi(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  uint32_t imm_se = ins->imm;
   uint32_t res = imm_se + cpu->regs[rs.data];
   bool overflow = ((cpu->regs[rs.data] ^ res) & (imm_se ^ res)) >> 31;
 
@@ -286,8 +435,8 @@ void op_addi(Cpu *cpu, Ins ins) {
   set_reg(cpu, rt, res);
 }
 
-void op_j(Cpu *cpu, Ins ins) {
-  uint32_t imm_jump = get_imm_jump(ins);
+void op_j(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_jump = ins->imm;
   cpu->branch = true;
 
   cpu->next_pc = MAKE_Addr((cpu->next_pc.data & 0xF0000000) | (imm_jump << 2));
@@ -295,15 +444,15 @@ void op_j(Cpu *cpu, Ins ins) {
   delayed_load(cpu);
 }
 
-void op_jal(Cpu *cpu, Ins ins) {
+void op_jal(Cpu *cpu, DecodedIns const *ins) {
   uint32_t ra = cpu->next_pc.data;
   op_j(cpu, ins);
   set_reg(cpu, MAKE_RegIndex(0x1F), ra);
 }
 
-void op_jalr(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rd = get_rd(ins);
+void op_jalr(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rd = ins->rd;
 
   uint32_t ra = cpu->next_pc.data;
   cpu->next_pc = MAKE_Addr(cpu->regs[rs.data]);
@@ -314,10 +463,10 @@ void op_jalr(Cpu *cpu, Ins ins) {
   cpu->branch = true;
 }
 
-void op_or(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_or(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t reg_s = cpu->regs[rs.data];
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -326,10 +475,10 @@ void op_or(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_s | reg_t);
 }
 
-void op_and(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_and(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t reg_s = cpu->regs[rs.data];
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -338,10 +487,10 @@ void op_and(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_s & reg_t);
 }
 
-void op_nor(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_nor(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t reg_s = cpu->regs[rs.data];
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -350,10 +499,10 @@ void op_nor(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, ~(reg_s | reg_t));
 }
 
-void op_xor(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_xor(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t reg_s = cpu->regs[rs.data];
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -362,9 +511,9 @@ void op_xor(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_s ^ reg_t);
 }
 
-void op_mtc0(Cpu *cpu, Ins ins) {
-  RegIndex rt = get_rt(ins);
-  uint8_t cop_reg = get_cop_reg(ins);
+void op_mtc0(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rt = ins->rt;
+  uint8_t cop_reg = ins->rd.data;
   uint32_t val = cpu->regs[rt.data];
 
   delayed_load(cpu);
@@ -392,9 +541,9 @@ void op_mtc0(Cpu *cpu, Ins ins) {
   }
 }
 
-void op_mfc0(Cpu *cpu, Ins ins) {
-  RegIndex rt = get_rt(ins);
-  uint8_t cop_reg = get_cop_reg(ins);
+void op_mfc0(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rt = ins->rt;
+  uint8_t cop_reg = ins->rd.data;
 
   switch (cop_reg) {
     case 6:
@@ -422,29 +571,29 @@ void op_mfc0(Cpu *cpu, Ins ins) {
   }
 }
 
-void op_lwc2(Cpu *cpu, Ins ins) {
-  fatal("Unhandled GTE LWC. Ins: 0x%08X", ins);
+void op_lwc2(Cpu *cpu, DecodedIns const *ins) {
+  fatal("Unhandled GTE LWC. Ins: 0x%08X", ins->ins.data);
 }
 
-void op_swc2(Cpu *cpu, Ins ins) {
-  fatal("Unhandled GTE SWC. Ins: 0x%08X", ins);
+void op_swc2(Cpu *cpu, DecodedIns const *ins) {
+  fatal("Unhandled GTE SWC. Ins: 0x%08X", ins->ins.data);
 }
 
-void op_rfe(Cpu *cpu, Ins ins) {
+void op_rfe(Cpu *cpu, DecodedIns const *ins) {
   delayed_load(cpu);
 
-  if ((ins.data & 0x3F) != 0x10)
-    fatal("Invalid cop0 instruction: 0x%08X", ins);
+  if ((ins->ins.data & 0x3F) != 0x10)
+    fatal("Invalid cop0 instruction: 0x%08X", ins->ins.data);
 
   uint32_t mode = cpu->sr & 0x3F;
   cpu->sr = cpu->sr & ~0xF;
   cpu->sr = cpu->sr | (mode >> 2);
 }
 
-void op_beq(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  uint32_t imm_se = get_imm_se(ins);
+void op_beq(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  uint32_t imm_se = ins->imm;
 
   if (cpu->regs[rs.data] == cpu->regs[rt.data])
     branch(cpu, imm_se);
@@ -452,10 +601,10 @@ void op_beq(Cpu *cpu, Ins ins) {
   delayed_load(cpu);
 }
 
-void op_bne(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  uint32_t imm_se = get_imm_se(ins);
+void op_bne(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  uint32_t imm_se = ins->imm;
 
   if (cpu->regs[rs.data] != cpu->regs[rt.data])
     branch(cpu, imm_se);
@@ -463,9 +612,9 @@ void op_bne(Cpu *cpu, Ins ins) {
   delayed_load(cpu);
 }
 
-void op_blez(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  uint32_t imm_se = get_imm_se(ins);
+void op_blez(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  uint32_t imm_se = ins->imm;
 
   int32_t reg_s = cpu->regs[rs.data];
 
@@ -475,9 +624,9 @@ void op_blez(Cpu *cpu, Ins ins) {
   delayed_load(cpu);
 }
 
-void op_bgtz(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  uint32_t imm_se = get_imm_se(ins);
+void op_bgtz(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  uint32_t imm_se = ins->imm;
 
   int32_t reg_s = cpu->regs[rs.data];
 
@@ -487,15 +636,10 @@ void op_bgtz(Cpu *cpu, Ins ins) {
   delayed_load(cpu);
 }
 
-void op_lw(Cpu *cpu, Ins ins) {
-  if (cpu->sr & 0x10000) {
-    log_info("Ignoring load calls while cache is isolated");
-    return;
-  }
-
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_lw(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
 
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
 
@@ -505,43 +649,33 @@ void op_lw(Cpu *cpu, Ins ins) {
     return;
   }
 
-  delayed_load_chain(cpu, rt, load(&cpu->inter, &cpu->shared, addr, AddrWord));
+  delayed_load_chain(cpu, rt, cpu_load(cpu, addr, AddrWord));
 }
 
-void op_lb(Cpu *cpu, Ins ins) {
-  if (cpu->sr & 0x10000) {
-    log_info("Ignoring load calls while cache is isolated");
-    return;
-  }
-
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_lb(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
 
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
-  int8_t data = load(&cpu->inter, &cpu->shared, addr, AddrByte);
+  int8_t data = cpu_load(cpu, addr, AddrByte);
   delayed_load_chain(cpu, rt, data);
 }
 
-void op_lbu(Cpu *cpu, Ins ins) {
-  if (cpu->sr & 0x10000) {
-    log_info("Ignoring load calls while cache is isolated");
-    return;
-  }
-
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_lbu(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
 
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
-  uint8_t data = load(&cpu->inter, &cpu->shared, addr, AddrByte);
+  uint8_t data = cpu_load(cpu, addr, AddrByte);
   delayed_load_chain(cpu, rt, data);
 }
 
-void op_sltu(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_sltu(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t reg_s = cpu->regs[rs.data];
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -550,10 +684,10 @@ void op_sltu(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_s < reg_t);
 }
 
-void op_slt(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_slt(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   int32_t reg_s = cpu->regs[rs.data];
   int32_t reg_t = cpu->regs[rt.data];
 
@@ -562,10 +696,10 @@ void op_slt(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_s < reg_t);
 }
 
-void op_slti(Cpu *cpu, Ins ins) {
-  int32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_slti(Cpu *cpu, DecodedIns const *ins) {
+  int32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   int32_t reg_s = cpu->regs[rs.data];
 
   delayed_load(cpu);
@@ -573,10 +707,10 @@ void op_slti(Cpu *cpu, Ins ins) {
   set_reg(cpu, rt, reg_s < imm_se);
 }
 
-void op_sltiu(Cpu *cpu, Ins ins) {
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_sltiu(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   uint32_t reg_s = cpu->regs[rs.data];
 
   delayed_load(cpu);
@@ -584,10 +718,10 @@ void op_sltiu(Cpu *cpu, Ins ins) {
   set_reg(cpu, rt, reg_s < imm_se);
 }
 
-void op_add(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_add(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t res = cpu->regs[rs.data] + cpu->regs[rt.data];
   bool overflow = ((cpu->regs[rs.data] ^ res) & (cpu->regs[rt.data] ^ res)) >> 31;
 
@@ -601,10 +735,10 @@ void op_add(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, res);
 }
 
-void op_addu(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_addu(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t reg_s = cpu->regs[rs.data];
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -613,15 +747,10 @@ void op_addu(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_s + reg_t);
 }
 
-void op_sh(Cpu *cpu, Ins ins) {
-  if (cpu->sr & 0x10000) {
-    log_info("Ignoring store calls while cache is isolated");
-    return;
-  }
-
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  uint32_t imm_se = get_imm_se(ins);
+void op_sh(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  uint32_t imm_se = ins->imm;
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -632,45 +761,40 @@ void op_sh(Cpu *cpu, Ins ins) {
     return;
   }
 
-  LOG_OUTPUT(cpu->output_log_index, " Addr: %08x, NewValue: %08x",
+  LOG_OUTPUT(cpu->ctx, cpu->output_log_index, " Addr: %08x, NewValue: %08x",
         addr.data, reg_t
   );
-  store(&cpu->inter, &cpu->shared, addr, reg_t, AddrHalf);
+  cpu_store(cpu, addr, reg_t, AddrHalf);
 }
 
-void op_sb(Cpu *cpu, Ins ins) {
-  if (cpu->sr & 0x10000) {
-    log_info("Ignoring store calls while cache is isolated");
-    return;
-  }
-
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  uint32_t imm_se = get_imm_se(ins);
+void op_sb(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  uint32_t imm_se = ins->imm;
 
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
   uint32_t reg_t = cpu->regs[rt.data];
 
   delayed_load(cpu);
 
-  LOG_OUTPUT(cpu->output_log_index, " Addr: %08x, NewValue: %08x",
+  LOG_OUTPUT(cpu->ctx, cpu->output_log_index, " Addr: %08x, NewValue: %08x",
         addr.data, reg_t
   );
-  store(&cpu->inter, &cpu->shared, addr, reg_t, AddrByte);
+  cpu_store(cpu, addr, reg_t, AddrByte);
 }
 
-void op_jr(Cpu *cpu, Ins ins) {
-  cpu->next_pc = MAKE_Addr(cpu->regs[get_rs(ins).data]);
+void op_jr(Cpu *cpu, DecodedIns const *ins) {
+  cpu->next_pc = MAKE_Addr(cpu->regs[ins->rs.data]);
   delayed_load(cpu);
   cpu->branch = true;
 }
 
-void op_bxx(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  uint32_t imm_se = get_imm_se(ins);
+void op_bxx(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  uint32_t imm_se = ins->imm;
 
-  int is_bgez = (ins.data >> 16) & 0x1 ? 1 : 0;
-  int is_link = (((ins.data >> 17) & 0xf) == 0x8) ? 1 : 0;
+  int is_bgez = (ins->ins.data >> 16) & 0x1 ? 1 : 0;
+  int is_link = (((ins->ins.data >> 17) & 0xf) == 0x8) ? 1 : 0;
 
   int32_t reg_s = cpu->regs[rs.data];
   uint32_t test = (reg_s < 0);
@@ -686,10 +810,10 @@ void op_bxx(Cpu *cpu, Ins ins) {
   }
 }
 
-void op_sub(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_sub(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t res = cpu->regs[rs.data] - cpu->regs[rt.data];
   bool overflow = ((cpu->regs[rs.data] ^ res) & ~(cpu->regs[rt.data] ^ res)) >> 31;
 
@@ -703,10 +827,10 @@ void op_sub(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, res);
 }
 
-void op_subu(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_subu(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t reg_s = cpu->regs[rs.data];
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -715,10 +839,10 @@ void op_subu(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_s - reg_t);
 }
 
-void op_sra(Cpu *cpu, Ins ins) {
-  uint32_t shift = get_shift(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_sra(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t shift = ins->imm;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
 
   int32_t reg_t = cpu->regs[rt.data];
   reg_t = reg_t >> shift;
@@ -728,10 +852,10 @@ void op_sra(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_t);
 }
 
-void op_srav(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_srav(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
 
   int32_t reg_t = cpu->regs[rt.data];
   uint8_t shift = cpu->regs[rs.data] & 0x1F;
@@ -742,10 +866,10 @@ void op_srav(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_t);
 }
 
-void op_srl(Cpu *cpu, Ins ins) {
-  uint32_t shift = get_shift(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_srl(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t shift = ins->imm;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
   uint32_t reg_t = cpu->regs[rt.data];
 
   delayed_load(cpu);
@@ -753,10 +877,10 @@ void op_srl(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_t >> shift);
 }
 
-void op_srlv(Cpu *cpu, Ins ins) {
-  RegIndex rs =get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  RegIndex rd = get_rd(ins);
+void op_srlv(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs =ins->rs;
+  RegIndex rt = ins->rt;
+  RegIndex rd = ins->rd;
 
   uint32_t shift = cpu->regs[rs.data] & 0x1F;
   uint32_t reg_t = cpu->regs[rt.data];
@@ -766,15 +890,10 @@ void op_srlv(Cpu *cpu, Ins ins) {
   set_reg(cpu, rd, reg_t >> shift);
 }
 
-void op_lh(Cpu *cpu, Ins ins) {
-  if (cpu->sr & 0x10000) {
-    log_info("Ignoring store calls while cache is isolated");
-    return;
-  }
-
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
-  uint32_t imm_se = get_imm_se(ins);
+void op_lh(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
+  uint32_t imm_se = ins->imm;
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
 
   if (addr.data % 2) {
@@ -783,20 +902,15 @@ void op_lh(Cpu *cpu, Ins ins) {
     return;
   }
 
-  int16_t val = load(&cpu->inter, &cpu->shared, addr, AddrHalf);
+  int16_t val = cpu_load(cpu, addr, AddrHalf);
 
   delayed_load_chain(cpu, rt, val);
 }
 
-void op_lhu(Cpu *cpu, Ins ins) {
-  if (cpu->sr & 0x10000) {
-    log_info("Ignoring load calls while cache is isolated");
-    return;
-  }
-
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_lhu(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
 
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
 
@@ -806,13 +920,13 @@ void op_lhu(Cpu *cpu, Ins ins) {
     return;
   }
 
-  delayed_load_chain(cpu, rt, load(&cpu->inter, &cpu->shared, addr, AddrHalf));
+  delayed_load_chain(cpu, rt, cpu_load(cpu, addr, AddrHalf));
 }
 
-void op_lwl(Cpu *cpu, Ins ins) {
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_lwl(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
 
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
   uint32_t cur_val;
@@ -822,7 +936,7 @@ void op_lwl(Cpu *cpu, Ins ins) {
     cur_val = cpu->regs[rt.data];
 
   Addr aligned_addr = MAKE_Addr(addr.data & ~3);
-  Ins aligned_ins = MAKE_Ins(load(&cpu->inter, &cpu->shared, aligned_addr, AddrWord));
+  Ins aligned_ins = MAKE_Ins(cpu_load(cpu, aligned_addr, AddrWord));
 
   uint32_t val;
   switch (addr.data & 3) {
@@ -845,10 +959,10 @@ void op_lwl(Cpu *cpu, Ins ins) {
   delayed_load_chain(cpu, rt, val);
 }
 
-void op_lwr(Cpu *cpu, Ins ins) {
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_lwr(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
 
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
   uint32_t cur_val;
@@ -858,7 +972,7 @@ void op_lwr(Cpu *cpu, Ins ins) {
     cur_val = cpu->regs[rt.data];
 
   Addr aligned_addr = MAKE_Addr(addr.data & ~3);
-  Ins aligned_ins = MAKE_Ins(load(&cpu->inter, &cpu->shared, aligned_addr, AddrWord));
+  Ins aligned_ins = MAKE_Ins(cpu_load(cpu, aligned_addr, AddrWord));
 
   uint32_t val;
   switch (addr.data & 3) {
@@ -881,16 +995,16 @@ void op_lwr(Cpu *cpu, Ins ins) {
   delayed_load_chain(cpu, rt, val);
 }
 
-void op_swl(Cpu *cpu, Ins ins) {
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_swl(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
 
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
   uint32_t val = cpu->regs[rt.data];
 
   Addr aligned_addr = MAKE_Addr(addr.data & ~3);
-  uint32_t cur_val = load(&cpu->inter, &cpu->shared, aligned_addr, AddrWord);
+  uint32_t cur_val = cpu_load(cpu, aligned_addr, AddrWord);
 
   uint32_t final_val;
   switch (addr.data & 3) {
@@ -912,19 +1026,19 @@ void op_swl(Cpu *cpu, Ins ins) {
 
   delayed_load(cpu);
 
-  store(&cpu->inter, &cpu->shared, aligned_addr, final_val, AddrWord);
+  cpu_store(cpu, aligned_addr, final_val, AddrWord);
 }
 
-void op_swr(Cpu *cpu, Ins ins) {
-  uint32_t imm_se = get_imm_se(ins);
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_swr(Cpu *cpu, DecodedIns const *ins) {
+  uint32_t imm_se = ins->imm;
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
 
   Addr addr = MAKE_Addr(cpu->regs[rs.data] + imm_se);
   uint32_t val = cpu->regs[rt.data];
 
   Addr aligned_addr = MAKE_Addr(addr.data & ~3);
-  uint32_t cur_val = load(&cpu->inter, &cpu->shared, aligned_addr, AddrWord);
+  uint32_t cur_val = cpu_load(cpu, aligned_addr, AddrWord);
 
   uint32_t final_val;
   switch (addr.data & 3) {
@@ -946,11 +1060,11 @@ void op_swr(Cpu *cpu, Ins ins) {
 
   delayed_load(cpu);
 
-  store(&cpu->inter, &cpu->shared, aligned_addr, final_val, AddrWord);
+  cpu_store(cpu, aligned_addr, final_val, AddrWord);
 }
-void op_mult(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_mult(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   int32_t reg_s = cpu->regs[rs.data];
   int32_t reg_t = cpu->regs[rt.data];
   int64_t reg_s_64 = reg_s;
@@ -963,9 +1077,9 @@ void op_mult(Cpu *cpu, Ins ins) {
   cpu->lo = prod;
 }
 
-void op_multu(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_multu(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   uint64_t reg_s = cpu->regs[rs.data];
   uint64_t reg_t = cpu->regs[rt.data];
 
@@ -976,9 +1090,9 @@ void op_multu(Cpu *cpu, Ins ins) {
   cpu->lo = prod;
 }
 
-void op_div(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_div(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   int32_t reg_s = cpu->regs[rs.data];
   int32_t reg_t = cpu->regs[rt.data];
 
@@ -996,9 +1110,9 @@ void op_div(Cpu *cpu, Ins ins) {
   }
 }
 
-void op_divu(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
-  RegIndex rt = get_rt(ins);
+void op_divu(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
+  RegIndex rt = ins->rt;
   uint32_t reg_s = cpu->regs[rs.data];
   uint32_t reg_t = cpu->regs[rt.data];
 
@@ -1013,315 +1127,301 @@ void op_divu(Cpu *cpu, Ins ins) {
   }
 }
 
-void op_mflo(Cpu *cpu, Ins ins) {
-  RegIndex rd = get_rd(ins);
+void op_mflo(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rd = ins->rd;
 
   delayed_load(cpu);
 
   set_reg(cpu, rd, cpu->lo);
 }
 
-void op_mtlo(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
+void op_mtlo(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
 
   cpu->lo = cpu->regs[rs.data];
 
   delayed_load(cpu);
 }
 
-void op_mfhi(Cpu *cpu, Ins ins) {
-  RegIndex rd = get_rd(ins);
+void op_mfhi(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rd = ins->rd;
 
   delayed_load(cpu);
 
   set_reg(cpu, rd, cpu->hi);
 }
 
-void op_mthi(Cpu *cpu, Ins ins) {
-  RegIndex rs = get_rs(ins);
+void op_mthi(Cpu *cpu, DecodedIns const *ins) {
+  RegIndex rs = ins->rs;
 
   cpu->hi = cpu->regs[rs.data];
 
   delayed_load(cpu);
 }
 
-void op_syscall(Cpu *cpu, Ins ins) {
+void op_syscall(Cpu *cpu, DecodedIns const *ins) {
   delayed_load(cpu);
 
   exception(cpu, SysCall);
 }
 
-void op_break(Cpu *cpu, Ins ins) {
+void op_break(Cpu *cpu, DecodedIns const *ins) {
   delayed_load(cpu);
 
   exception(cpu, Break);
 }
 
-void op_mfc2(Cpu *cpu, Ins ins) {
+void op_mfc2(Cpu *cpu, DecodedIns const *ins) {
   log_error("STUB: op_mfc2 unimplemented!");
 }
 
-void op_cfc2(Cpu *cpu, Ins ins) {
+void op_cfc2(Cpu *cpu, DecodedIns const *ins) {
   log_error("STUB: op_cfc2 unimplemented!");
 }
 
-void op_mtc2(Cpu *cpu, Ins ins) {
+void op_mtc2(Cpu *cpu, DecodedIns const *ins) {
   log_error("STUB: op_mtc2 unimplemented!");
 }
 
-void op_ctc2(Cpu *cpu, Ins ins) {
+void op_ctc2(Cpu *cpu, DecodedIns const *ins) {
   log_error("STUB: op_ctc2 unimplemented!");
 }
 
-void op_cop0(Cpu *cpu, Ins ins) {
-  switch (get_cop_func(ins)) {
+void op_gte_command(Cpu *cpu, DecodedIns const *ins) {
+  fatal("GTE Command Unhandled! Ins: 0x%08X, Opcode: 0x%08X", ins->ins.data, get_cop_func(ins->ins));
+}
+
+void op_illegal(Cpu *cpu, DecodedIns const *ins) {
+  exception(cpu, IllegalInstruction);
+}
+
+void op_cop_unusable(Cpu *cpu, DecodedIns const *ins) {
+  exception(cpu, CoprocessorError);
+}
+
+// Instructions allowed in an idle loop: no stores, jumps, traps,
+// coprocessor writes or hi/lo updates
+static bool is_idle_safe(DecodedIns const *ins) {
+  OpHandler handler = ins->handler;
+
+  return handler == op_lw || handler == op_lh || handler == op_lhu ||
+    handler == op_lb || handler == op_lbu || handler == op_mfc0 ||
+    handler == op_addiu || handler == op_addu || handler == op_subu ||
+    handler == op_and || handler == op_andi || handler == op_or ||
+    handler == op_ori || handler == op_xor || handler == op_xori ||
+    handler == op_nor || handler == op_lui || handler == op_sll ||
+    handler == op_srl || handler == op_sra || handler == op_sllv ||
+    handler == op_srlv || handler == op_srav || handler == op_slt ||
+    handler == op_sltu || handler == op_slti || handler == op_sltiu ||
+    handler == op_mfhi || handler == op_mflo || handler == op_beq ||
+    handler == op_bne || handler == op_blez || handler == op_bgtz ||
+    handler == op_bxx;
+}
+
+static bool is_idle_loop(Cpu *cpu, Addr start, Addr branch_pc) {
+  if (branch_pc.data - start.data >= 4 * IDLE_LOOP_MAX_INS)
+    return false;
+
+  // The delay slot runs on every iteration too
+  for (uint32_t pc = start.data; pc <= branch_pc.data + 4; pc += 4) {
+    DecodedIns uncached;
+    if (!is_idle_safe(fetch_decoded_ins(cpu, MAKE_Addr(pc), &uncached)))
+      return false;
+  }
+
+  return true;
+}
+
+// Called on every taken backward branch. A side-effect free loop whose
+// registers come out of an iteration unchanged will spin until some
+// peripheral changes state, so skip the clock ahead to the next sync.
+static void check_idle_loop(Cpu *cpu, Addr target) {
+  IdleLoop *idle = &cpu->idle_loop;
+
+  if (idle->branch_pc.data != cpu->current_pc.data) {
+    idle->branch_pc = cpu->current_pc;
+    idle->candidate = is_idle_loop(cpu, target, cpu->current_pc);
+  } else if (idle->candidate &&
+      memcmp(idle->regs, cpu->regs, sizeof idle->regs) == 0 &&
+      idle->hi == cpu->hi && idle->lo == cpu->lo &&
+      idle->load_delay_slot.index.data == cpu->load_delay_slot.index.data &&
+      idle->load_delay_slot.val == cpu->load_delay_slot.val) {
+    Clock *clock = &cpu->shared.clock;
+    uint64_t until = clock->next_sync.data;
+
+    if (cpu->run_end && cpu->run_end < until)
+      until = cpu->run_end;
+    if (until != UINT64_MAX && until > clock->now.data)
+      clock->now = MAKE_Cycles(until);
+  }
+
+  if (idle->candidate) {
+    memcpy(idle->regs, cpu->regs, sizeof idle->regs);
+    idle->hi = cpu->hi;
+    idle->lo = cpu->lo;
+    idle->load_delay_slot = cpu->load_delay_slot;
+  }
+}
+
+// Handlers indexed by get_func. SPECIAL, COP0 and COP2 are resolved
+// through their own tables; empty entries are illegal instructions.
+static OpHandler const primary_handlers[64] = {
+  [0x1] = op_bxx,
+  [0x2] = op_j,
+  [0x3] = op_jal,
+  [0x4] = op_beq,
+  [0x5] = op_bne,
+  [0x6] = op_blez,
+  [0x7] = op_bgtz,
+  [0x8] = op_addi,
+  [0x9] = op_addiu,
+  [0xA] = op_slti,
+  [0xB] = op_sltiu,
+  [0xC] = op_andi,
+  [0xD] = op_ori,
+  [0xE] = op_xori,
+  [0xF] = op_lui,
+  [0x11] = op_cop_unusable,
+  [0x13] = op_cop_unusable,
+  [0x20] = op_lb,
+  [0x21] = op_lh,
+  [0x22] = op_lwl,
+  [0x23] = op_lw,
+  [0x24] = op_lbu,
+  [0x25] = op_lhu,
+  [0x26] = op_lwr,
+  [0x28] = op_sb,
+  [0x29] = op_sh,
+  [0x2A] = op_swl,
+  [0x2B] = op_sw,
+  [0x2E] = op_swr,
+  [0x30] = op_cop_unusable,
+  [0x31] = op_cop_unusable,
+  [0x32] = op_lwc2,
+  [0x33] = op_cop_unusable,
+  [0x38] = op_cop_unusable,
+  [0x39] = op_cop_unusable,
+  [0x3A] = op_swc2,
+  [0x3B] = op_cop_unusable
+};
+
+// Indexed by get_sub_func
+static OpHandler const special_handlers[64] = {
+  [0x0] = op_sll,
+  [0x2] = op_srl,
+  [0x3] = op_sra,
+  [0x4] = op_sllv,
+  [0x6] = op_srlv,
+  [0x7] = op_srav,
+  [0x8] = op_jr,
+  [0x9] = op_jalr,
+  [0xC] = op_syscall,
+  [0xD] = op_break,
+  [0x10] = op_mfhi,
+  [0x11] = op_mthi,
+  [0x12] = op_mflo,
+  [0x13] = op_mtlo,
+  [0x18] = op_mult,
+  [0x19] = op_multu,
+  [0x1A] = op_div,
+  [0x1B] = op_divu,
+  [0x20] = op_add,
+  [0x21] = op_addu,
+  [0x22] = op_sub,
+  [0x23] = op_subu,
+  [0x24] = op_and,
+  [0x25] = op_or,
+  [0x26] = op_xor,
+  [0x27] = op_nor,
+  [0x2A] = op_slt,
+  [0x2B] = op_sltu
+};
+
+// Indexed by get_cop_func
+static OpHandler const cop0_handlers[32] = {
+  [0x0] = op_mfc0,
+  [0x4] = op_mtc0,
+  [0x10] = op_rfe
+};
+
+// Indexed by get_cop_func; the upper half are GTE commands
+static OpHandler const cop2_handlers[32] = {
+  [0x0] = op_mfc2,
+  [0x2] = op_cfc2,
+  [0x4] = op_mtc2,
+  [0x6] = op_ctc2,
+  [0x10] = op_gte_command,
+  [0x11] = op_gte_command,
+  [0x12] = op_gte_command,
+  [0x13] = op_gte_command,
+  [0x14] = op_gte_command,
+  [0x15] = op_gte_command,
+  [0x16] = op_gte_command,
+  [0x17] = op_gte_command,
+  [0x18] = op_gte_command,
+  [0x19] = op_gte_command,
+  [0x1A] = op_gte_command,
+  [0x1B] = op_gte_command,
+  [0x1C] = op_gte_command,
+  [0x1D] = op_gte_command,
+  [0x1E] = op_gte_command,
+  [0x1F] = op_gte_command
+};
+
+OpHandler decode_handler(Ins ins) {
+  OpHandler handler;
+
+  switch (get_func(ins)) {
     case 0x0:
-      op_mfc0(cpu, ins);
-      break;
-    case 0x4:
-      op_mtc0(cpu, ins);
+      handler = special_handlers[get_sub_func(ins)];
       break;
     case 0x10:
-      op_rfe(cpu, ins);
+      handler = cop0_handlers[get_cop_func(ins)];
+      break;
+    case 0x12:
+      handler = cop2_handlers[get_cop_func(ins)];
       break;
     default:
-      exception(cpu, IllegalInstruction);
+      handler = primary_handlers[get_func(ins)];
   }
-}
 
-void op_cop2(Cpu *cpu, Ins ins) {
-  // ToDo: Check if GTE is enabled in cop0's
-  // status register. Futhermore, we need to
-  // wait two cycles after raising the flag in
-  // the status register before GTE can be accessed.
-  uint32_t opcode = get_cop_func(ins);
-
-  if (opcode & 0x10) {
-    fatal("GTE Command Unhandled! Ins: 0x%08X, Opcode: 0x%08X", ins, opcode);
-  } else {
-    switch(opcode) {
-      case 0x0:
-        op_mfc2(cpu, ins);
-        break;
-      case 0x2:
-        op_cfc2(cpu, ins);
-        break;
-      case 0x4:
-        op_mtc2(cpu, ins);
-        break;
-      case 0x6:
-        op_ctc2(cpu, ins);
-        break;
-      default:
-        exception(cpu, IllegalInstruction);
-    }
-  }
+  return handler ? handler : op_illegal;
 }
 
-void decode_and_execute(Cpu *cpu, Ins ins) {
+void decode_ins(DecodedIns *decoded, Ins ins) {
+  decoded->handler = decode_handler(ins);
+  decoded->ins = ins;
+  decoded->rs = get_rs(ins);
+  decoded->rt = get_rt(ins);
+  decoded->rd = get_rd(ins);
+
   switch (get_func(ins)) {
     case 0x0:
-      switch (get_sub_func(ins)) {
-        case 0x0:
-          op_sll(cpu, ins);
-          break;
-        case 0x2:
-          op_srl(cpu, ins);
-          break;
-        case 0x3:
-          op_sra(cpu, ins);
-          break;
-        case 0x4:
-          op_sllv(cpu, ins);
-          break;
-        case 0x6:
-          op_srlv(cpu, ins);
-          break;
-        case 0x7:
-          op_srav(cpu, ins);
-          break;
-        case 0x8:
-          op_jr(cpu, ins);
-          break;
-        case 0x9:
-          op_jalr(cpu, ins);
-          break;
-        case 0xC:
-          op_syscall(cpu, ins);
-          break;
-        case 0xD:
-          op_break(cpu, ins);
-          break;
-        case 0x10:
-          op_mfhi(cpu, ins);
-          break;
-        case 0x11:
-          op_mthi(cpu, ins);
-          break;
-        case 0x12:
-          op_mflo(cpu, ins);
-          break;
-        case 0x13:
-          op_mtlo(cpu, ins);
-          break;
-        case 0x18:
-          op_mult(cpu, ins);
-          break;
-        case 0x19:
-          op_multu(cpu, ins);
-          break;
-        case 0x1A:
-          op_div(cpu, ins);
-          break;
-        case 0x1B:
-          op_divu(cpu, ins);
-          break;
-        case 0x20:
-          op_add(cpu, ins);
-          break;
-        case 0x21:
-          op_addu(cpu, ins);
-          break;
-        case 0x22:
-          op_sub(cpu, ins);
-          break;
-        case 0x23:
-          op_subu(cpu, ins);
-          break;
-        case 0x24:
-          op_and(cpu, ins);
-          break;
-        case 0x25:
-          op_or(cpu, ins);
-          break;
-        case 0x26:
-          op_xor(cpu, ins);
-          break;
-        case 0x27:
-          op_nor(cpu, ins);
-          break;
-        case 0x2A:
-          op_slt(cpu, ins);
-          break;
-        case 0x2B:
-          op_sltu(cpu, ins);
-          break;
-        default:
-          exception(cpu, IllegalInstruction);
-      }
-      break;
-    case 0x1:
-      op_bxx(cpu, ins);
+      decoded->imm = get_shift(ins);
       break;
     case 0x2:
-      op_j(cpu, ins);
-      break;
     case 0x3:
-      op_jal(cpu, ins);
-      break;
-   case 0x4:
-      op_beq(cpu, ins);
-      break;
-    case 0x5:
-      op_bne(cpu, ins);
-      break;
-    case 0x6:
-      op_blez(cpu, ins);
-      break;
-    case 0x7:
-      op_bgtz(cpu, ins);
-      break;
-    case 0x8:
-      op_addi(cpu, ins);
-      break;
-    case 0x9:
-      op_addiu(cpu, ins);
-      break;
-    case 0xA:
-      op_slti(cpu, ins);
-      break;
-    case 0xB:
-      op_sltiu(cpu, ins);
+      decoded->imm = get_imm_jump(ins);
       break;
     case 0xC:
-      op_andi(cpu, ins);
-      break;
     case 0xD:
-      op_ori(cpu, ins);
-      break;
     case 0xE:
-      op_xori(cpu, ins);
-      break;
     case 0xF:
-      op_lui(cpu, ins);
-      break;
-    case 0x10:
-      op_cop0(cpu, ins);
-      break;
-    case 0x11:
-    case 0x13:
-      exception(cpu, CoprocessorError);
-      break;
-    case 0x12:
-      op_cop2(cpu, ins);
-      break;
-   case 0x20:
-      op_lb(cpu, ins);
-      break;
-    case 0x21:
-      op_lh(cpu, ins);
-      break;
-    case 0x22:
-      op_lwl(cpu, ins);
-      break;
-    case 0x23:
-      op_lw(cpu, ins);
-      break;
-    case 0x24:
-      op_lbu(cpu, ins);
-      break;
-    case 0x25:
-      op_lhu(cpu, ins);
-      break;
-    case 0x26:
-      op_lwr(cpu, ins);
-      break;
-    case 0x28:
-      op_sb(cpu, ins);
-      break;
-    case 0x29:
-      op_sh(cpu, ins);
-      break;
-    case 0x2A:
-      op_swl(cpu, ins);
-      break;
-    case 0x2B:
-      op_sw(cpu, ins);
-      break;
-    case 0x2E:
-      op_swr(cpu, ins);
-      break;
-    case 0x30:
-    case 0x31:
-    case 0x33:
-      exception(cpu, CoprocessorError);
-      break;
-    case 0x32:
-      op_lwc2(cpu, ins);
-      break;
-    case 0x38:
-    case 0x39:
-    case 0x3B:
-      exception(cpu, CoprocessorError);
-      break;
-    case 0x3A:
-      op_swc2(cpu, ins);
+      decoded->imm = get_imm(ins);
       break;
     default:
-      exception(cpu, IllegalInstruction);
+      decoded->imm = get_imm_se(ins);
   }
 }
 
+void decode_and_execute(Cpu *cpu, Ins ins) {
+  DecodedIns decoded;
+
+  decode_ins(&decoded, ins);
+  decoded.handler(cpu, &decoded);
+}
+
 void destroy_cpu(Cpu *cpu) {
+  destroy_jit(&cpu->jit);
   destroy_interconnect(&cpu->inter);
 }
@@ -0,0 +1,42 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "dirty.h"
+#include "log.h"
+
+DirtyMap init_dirty_map(uint32_t size) {
+  DirtyMap map;
+
+  map.page_count = (size + DIRTY_PAGE_SIZE - 1) >> DIRTY_PAGE_SHIFT;
+  if (map.page_count > DIRTY_MAP_MAX_PAGES)
+    fatal("MemoryError: Buffer too large for a dirty map: %u bytes", size);
+  mark_all_dirty(&map);
+
+  return map;
+}
+
+void mark_dirty_range(DirtyMap *map, uint32_t offset, uint32_t size) {
+  if (size == 0)
+    return;
+
+  uint32_t last = (offset + size - 1) >> DIRTY_PAGE_SHIFT;
+  if (last >= map->page_count)
+    last = map->page_count - 1;
+
+  for (uint32_t page = offset >> DIRTY_PAGE_SHIFT; page <= last; page++)
+    map->bits[page >> 6] |= 1ULL << (page & 63);
+}
+
+void mark_all_dirty(DirtyMap *map) {
+  memset(map->bits, 0, sizeof map->bits);
+  mark_dirty_range(map, 0, map->page_count << DIRTY_PAGE_SHIFT);
+}
+
+void clear_dirty(DirtyMap *map) {
+  memset(map->bits, 0, sizeof map->bits);
+}
+
+void merge_dirty(DirtyMap *map, DirtyMap const *other) {
+  for (size_t index = 0; index < DIRTY_MAP_MAX_PAGES / 64; index++)
+    map->bits[index] |= other->bits[index];
+}
@@ -83,8 +83,15 @@ uint32_t get_dma_channel_transfer_size(DmaChannel *channel) {
 Dma init_dma() {
   Dma dma;
   dma.control = 0x07654321;
-  for(size_t index = 0; index < DmaChannelCount; index++)
+  dma.irq_master_en = false;
+  dma.irq_channel_en = 0;
+  dma.irq_channel_flags = 0;
+  dma.irq_force = false;
+  dma.irq_dummy = 0;
+  for(size_t index = 0; index < DmaChannelCount; index++) {
+    dma.channels[index] = init_dma_channel();
     dma.channels[index].port = index;
+  }
 
   return dma;
 }
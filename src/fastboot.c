@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#include "fastboot.h"
+#include "savestate.h"
+#include "log.h"
+
+// Runs the BIOS up to the jump into the shell
+static void boot_to_shell(Cpu *cpu) {
+  Clock *clock = &cpu->shared.clock;
+
+  while (cpu->pc.data != SIDELOAD_HOOK_PC) {
+    if (clock->now.data >= BOOT_MAX_CYCLES)
+      fatal("BootError: BIOS never reached the shell");
+
+    run_next_ins(cpu);
+
+    if (sync_pending(clock))
+      interconnect_sync(&cpu->inter, &cpu->shared);
+  }
+}
+
+void fast_boot(Cpu *cpu, char const *cache_dir) {
+  char filename[1024];
+  snprintf(filename, sizeof filename, "%s/boot-%016" PRIx64 ".state", cache_dir, bios_hash(&cpu->inter.bios));
+
+  FILE *cached = fopen(filename, "rb");
+  if (cached) {
+    fclose(cached);
+    if (load_state(cpu, filename)) {
+      log_info("Fast boot: restored %s", filename);
+      return;
+    }
+  }
+
+  boot_to_shell(cpu);
+
+  // Concurrent runs must never see a partially written state
+  char tmp_filename[1024 + 8];
+  snprintf(tmp_filename, sizeof tmp_filename, "%s.XXXXXX", filename);
+  int fd = mkstemp(tmp_filename);
+  // mkstemp creates it 0600, but the cache directory can be shared
+  mode_t mask = umask(0);
+  umask(mask);
+  if (fd >= 0)
+    fchmod(fd, 0644 & ~mask);
+  FILE *fp = (fd >= 0) ? fdopen(fd, "wb") : NULL;
+
+  if (fp && write_state(cpu, fp) && rename(tmp_filename, filename) == 0)
+    log_info("Fast boot: cached %s", filename);
+  else {
+    if (fd >= 0)
+      remove(tmp_filename);
+    log_warn("Fast boot: couldn't cache %s", filename);
+  }
+}
@@ -4,6 +4,10 @@
 #include "gpu.h"
 #include "log.h"
 #include "output_logger.h"
+#include "flag.h"
+#include "raster.h"
+#include "gpu_thread.h"
+#include "gpu_tiles.h"
 
 GpuCommandBuffer init_command_buffer() {
   GpuCommandBuffer buffer;
@@ -14,36 +18,58 @@ GpuCommandBuffer init_command_buffer() {
   return buffer;
 }
 
-GpuRenderer init_renderer() {
+GpuRenderer init_renderer(bool headless) {
   GpuRenderer renderer;
 
-  renderer.window = SDL_CreateWindow("PSX", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, 1024, 512, 0);
-  renderer.window_surface = SDL_GetWindowSurface(renderer.window);
-  if (renderer.window_surface == NULL)
-    fatal("SDLError: Couldn't initialize window_surface: %s", SDL_GetError());
-  renderer.vram_surface = SDL_CreateRGBSurfaceWithFormat(0, 1024, 512, 16, SDL_PIXELFORMAT_RGB555);
-  if (renderer.vram_surface == NULL)
-    fatal("SDLError: Couldn't initialize vram_surface: %s", SDL_GetError());
+  renderer.vram = calloc(VRAM_WIDTH * VRAM_HEIGHT, sizeof(uint16_t));
+  if (renderer.vram == NULL)
+    fatal("MemoryError: Couldn't allocate VRAM");
+
+  renderer.window = NULL;
+  renderer.window_surface = NULL;
+  renderer.vram_surface = NULL;
+
+  if (!headless) {
+    renderer.window = SDL_CreateWindow("PSX", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED, VRAM_WIDTH, VRAM_HEIGHT, 0);
+    renderer.window_surface = SDL_GetWindowSurface(renderer.window);
+    if (renderer.window_surface == NULL)
+      fatal("SDLError: Couldn't initialize window_surface: %s", SDL_GetError());
+    // Wraps `vram`, so blitting it needs no copy
+    renderer.vram_surface = SDL_CreateRGBSurfaceWithFormatFrom(renderer.vram, VRAM_WIDTH, VRAM_HEIGHT, 16, VRAM_WIDTH * sizeof(uint16_t), SDL_PIXELFORMAT_RGB555);
+    if (renderer.vram_surface == NULL)
+      fatal("SDLError: Couldn't initialize vram_surface: %s", SDL_GetError());
+  }
 
   renderer.render_mode = GpuRenderTri;
+  renderer.vram_dirty = init_dirty_map(VRAM_WIDTH * VRAM_HEIGHT * sizeof(uint16_t));
+  renderer.kernels = select_raster_kernels();
 
   return renderer;
 }
 
 void renderer_update_window(GpuRenderer *renderer) {
+  if (renderer->window == NULL)
+    return;
+
   SDL_BlitSurface(renderer->vram_surface, 0, renderer->window_surface, 0);
   SDL_UpdateWindowSurface(renderer->window);
 }
 
 void destroy_renderer(GpuRenderer *renderer) {
-  SDL_DestroyWindow(renderer->window);
+  if (renderer->window) {
+    SDL_FreeSurface(renderer->vram_surface);
+    SDL_DestroyWindow(renderer->window);
+  }
+  free(renderer->vram);
 }
 
 void gp0_nop(Gpu *gpu, uint32_t val);
 
-Gpu init_gpu() {
+Gpu init_gpu(Context *ctx) {
   Gpu gpu;
 
+  gpu.ctx = ctx;
+
   gpu.texture_page[0] = gpu.texture_page[1] = 0;
   gpu.clut[0] = gpu.clut[1] = 0;
   gpu.semi_transparent = false;
@@ -92,9 +118,11 @@ Gpu init_gpu() {
   gpu.image_buffer.height = 0;
   gpu.image_buffer.x = 0;
   gpu.image_buffer.y = 0;
-  gpu.renderer = init_renderer();
+  gpu.renderer = init_renderer(get_flag(ctx, HEADLESS));
   gpu.read_word = 0;
-  gpu.output_log_index = init_output_log();
+  gpu.output_log_index = init_output_log(ctx);
+  gpu.thread = NULL;
+  gpu.tiles = NULL;
 
   return gpu;
 }
@@ -102,6 +130,9 @@ Gpu init_gpu() {
 uint32_t gpu_status(Gpu *gpu) {
   uint32_t status = 0;
 
+  // GP0 commands set the texture page and drawing bits
+  gpu_sync(gpu);
+
   status |= gpu->texture_page[0] >> 6;
   status |= (gpu->texture_page[1] >> 8) << 4;
   status |= ((uint32_t)gpu->semi_transparency_mode) << 5;
@@ -149,6 +180,8 @@ uint32_t gpu_status(Gpu *gpu) {
 }
 
 uint32_t gpu_read(Gpu *gpu) {
+  gpu_sync(gpu);
+
   if (gpu->gp0_mode == Gp0ImageStoreMode) {
     pop_image_word(&gpu->image_buffer, &gpu->renderer, &gpu->read_word);
     if (gpu->gp0_words_remaining == 0) {
@@ -249,7 +282,9 @@ void gp0_set_drawing_offsets(Gpu *gpu, uint32_t val) {
   gpu->drawing_x_offset = gpu->drawing_x_offset >> 5;
   gpu->drawing_y_offset = gpu->drawing_y_offset >> 5;
 
-  renderer_update_window(&gpu->renderer);
+  // SDL isn't thread safe, the main loop presents instead
+  if (gpu->thread == NULL)
+    renderer_update_window(&gpu->renderer);
 }
 
 void gp0_texture_window(Gpu *gpu, uint32_t val) {
@@ -394,8 +429,20 @@ void gp0_monochrome_rect_1x1(Gpu *gpu, uint32_t val) {
   pos_from_gp0(command_buffer->commands[1], renderer->rect_pos);
   color_from_gp0(command_buffer->commands[0], renderer->rect_color);
 
-  uint16_t *target = get_vram(renderer, renderer->rect_pos[0], renderer->rect_pos[1]);
-  *target = vec_to_555(renderer->rect_color);
+  int32_t x = renderer->rect_pos[0];
+  int32_t y = renderer->rect_pos[1];
+  if (x < 0 || y < 0 || x >= VRAM_WIDTH || y >= VRAM_HEIGHT)
+    return;
+
+  GpuPrim prim;
+  prim.render_mode = GpuRenderRect;
+  prim.left = prim.right = x;
+  prim.top = prim.bottom = y;
+  prim.color = vec_to_555(renderer->rect_color);
+  prim.u = prim.v = 0;
+
+  mark_vram_rows(renderer, y, y + 1);
+  gpu_submit_prim(gpu, &prim);
 }
 
 void gp0_image_load(Gpu *gpu, uint32_t val) {
@@ -405,6 +452,9 @@ void gp0_image_load(Gpu *gpu, uint32_t val) {
   uint32_t size = width * height;
   size = (size + 1) & ~1;
 
+  // The image lands on top of everything drawn before it
+  gpu_flush(gpu);
+
   if (size > 0) {
     gpu->image_buffer.left = gpu->gp0_command_buffer.commands[1];
     gpu->image_buffer.top = gpu->gp0_command_buffer.commands[1] >> 16;
@@ -442,91 +492,116 @@ void gp0_image_store(Gpu *gpu, uint32_t val) {
   gpu->gp0_mode = Gp0ImageStoreMode;
 }
 
+// Picks the handler and argument count of the GP0 command starting with `val`
+static void select_gp0_method(Gpu *gpu, uint32_t val) {
+  uint8_t opcode = (val >> 24) & 0xFF;
+
+  switch (opcode) {
+    case 0x00:
+      gpu->gp0_method = gp0_nop;
+      gpu->gp0_words_remaining = 1;
+      break;
+    case 0x01:
+      gpu->gp0_method = gp0_clear_cache;
+      gpu->gp0_words_remaining = 1;
+      break;
+    case 0x02:
+      gpu->gp0_method = gp0_fill_rect;
+      gpu->gp0_words_remaining = 3;
+      break;
+    case 0x28:
+      gpu->gp0_method = gp0_monochrome_quad;
+      gpu->gp0_words_remaining = 5;
+      break;
+    case 0x2C:
+      gpu->gp0_method = gp0_texture_quad;
+      gpu->gp0_words_remaining = 9;
+      break;
+    case 0x30:
+      gpu->gp0_method = gp0_shaded_tri;
+      gpu->gp0_words_remaining = 6;
+      break;
+    case 0x38:
+      gpu->gp0_method = gp0_shaded_quad;
+      gpu->gp0_words_remaining = 8;
+      break;
+    case 0x60:
+      gpu->gp0_method = gp0_monochrome_rect;
+      gpu->gp0_words_remaining = 3;
+      break;
+    case 0x64:
+    case 0x65:
+    case 0x66:
+    case 0x67:
+      gpu->gp0_method = gp0_texture_rect;
+      gpu->gp0_words_remaining = 4;
+      break;
+    case 0x68:
+      gpu->gp0_method = gp0_monochrome_rect_1x1;
+      gpu->gp0_words_remaining = 2;
+      break;
+    case 0xA0:
+      gpu->gp0_method = gp0_image_load;
+      gpu->gp0_words_remaining = 3;
+      break;
+    case 0xC0:
+      gpu->gp0_method = gp0_image_store;
+      gpu->gp0_words_remaining = 3;
+      break;
+    case 0xE1:
+      gpu->gp0_method = gp0_draw_mode;
+      gpu->gp0_words_remaining = 1;
+      break;
+    case 0xE2:
+      gpu->gp0_method = gp0_texture_window;
+      gpu->gp0_words_remaining = 1;
+      break;
+    case 0xE3:
+      gpu->gp0_method = gp0_set_drawing_top_left;
+      gpu->gp0_words_remaining = 1;
+      break;
+    case 0xE4:
+      gpu->gp0_method = gp0_set_drawing_bottom_right;
+      gpu->gp0_words_remaining = 1;
+      break;
+    case 0xE5:
+      gpu->gp0_method = gp0_set_drawing_offsets;
+      gpu->gp0_words_remaining = 1;
+      break;
+    case 0xE6:
+      gpu->gp0_method = gp0_mask_bit_setting;
+      gpu->gp0_words_remaining = 1;
+      break;
+    default:
+      fatal("Unhandled GP0 Command: 0x%08X", val);
+  }
+}
+
+void gpu_restore_gp0_method(Gpu *gpu) {
+  if (gpu->gp0_mode != Gp0CommandMode || gpu->gp0_words_remaining == 0 || gpu->gp0_command_buffer.command_count == 0) {
+    gpu->gp0_method = gp0_nop;
+    return;
+  }
+
+  uint32_t words_remaining = gpu->gp0_words_remaining;
+  select_gp0_method(gpu, gpu->gp0_command_buffer.commands[0]);
+  gpu->gp0_words_remaining = words_remaining;
+}
+
 void gpu_gp0(Gpu *gpu, uint32_t val) {
+  if (gpu->thread)
+    gpu_thread_push(gpu->thread, val);
+  else
+    gpu_execute_gp0(gpu, val);
+}
+
+void gpu_execute_gp0(Gpu *gpu, uint32_t val) {
   if (gpu->gp0_words_remaining == 0) {
     uint8_t opcode = (val >> 24) & 0xFF;
 
-    LOG_OUTPUT(gpu->output_log_index, "GP0 Command: %08x", val);
-
-    switch (opcode) {
-      case 0x00:
-        gpu->gp0_method = gp0_nop;
-        gpu->gp0_words_remaining = 1;
-        break;
-      case 0x01:
-        gpu->gp0_method = gp0_clear_cache;
-        gpu->gp0_words_remaining = 1;
-        break;
-      case 0x02:
-        gpu->gp0_method = gp0_fill_rect;
-        gpu->gp0_words_remaining = 3;
-        break;
-      case 0x28:
-        gpu->gp0_method = gp0_monochrome_quad;
-        gpu->gp0_words_remaining = 5;
-        break;
-      case 0x2C:
-        gpu->gp0_method = gp0_texture_quad;
-        gpu->gp0_words_remaining = 9;
-        break;
-      case 0x30:
-        gpu->gp0_method = gp0_shaded_tri;
-        gpu->gp0_words_remaining = 6;
-        break;
-      case 0x38:
-        gpu->gp0_method = gp0_shaded_quad;
-        gpu->gp0_words_remaining = 8;
-        break;
-      case 0x60:
-        gpu->gp0_method = gp0_monochrome_rect;
-        gpu->gp0_words_remaining = 3;
-        break;
-      case 0x64:
-      case 0x65:
-      case 0x66:
-      case 0x67:
-        gpu->gp0_method = gp0_texture_rect;
-        gpu->gp0_words_remaining = 4;
-        break;
-      case 0x68:
-        gpu->gp0_method = gp0_monochrome_rect_1x1;
-        gpu->gp0_words_remaining = 2;
-        break;
-      case 0xA0:
-        gpu->gp0_method = gp0_image_load;
-        gpu->gp0_words_remaining = 3;
-        break;
-      case 0xC0:
-        gpu->gp0_method = gp0_image_store;
-        gpu->gp0_words_remaining = 3;
-        break;
-      case 0xE1:
-        gpu->gp0_method = gp0_draw_mode;
-        gpu->gp0_words_remaining = 1;
-        break;
-      case 0xE2:
-        gpu->gp0_method = gp0_texture_window;
-        gpu->gp0_words_remaining = 1;
-        break;
-      case 0xE3:
-        gpu->gp0_method = gp0_set_drawing_top_left;
-        gpu->gp0_words_remaining = 1;
-        break;
-      case 0xE4:
-        gpu->gp0_method = gp0_set_drawing_bottom_right;
-        gpu->gp0_words_remaining = 1;
-        break;
-      case 0xE5:
-        gpu->gp0_method = gp0_set_drawing_offsets;
-        gpu->gp0_words_remaining = 1;
-        break;
-      case 0xE6:
-        gpu->gp0_method = gp0_mask_bit_setting;
-        gpu->gp0_words_remaining = 1;
-        break;
-      default:
-        fatal("Unhandled GP0 Command: 0x%08X", val);
-    }
+    LOG_OUTPUT(gpu->ctx, gpu->output_log_index, "GP0 Command: %08x", val);
+
+    select_gp0_method(gpu, val);
 
     command_buffer_clear(&gpu->gp0_command_buffer);
 
@@ -538,7 +613,7 @@ void gpu_gp0(Gpu *gpu, uint32_t val) {
 
     gpu->semi_transparent = opcode & 0x2;
 
-    print_output_log(gpu->output_log_index);
+    print_output_log(gpu->ctx, gpu->output_log_index);
   }
 
   gpu->gp0_words_remaining -= 1;
@@ -694,7 +769,10 @@ void gp1_get_info(Gpu *gpu, uint32_t val) {
 void gpu_gp1(Gpu *gpu, uint32_t val) {
   uint8_t opcode = (val >> 24) & 0xFF;
 
-  LOG_OUTPUT(gpu->output_log_index, "GP1 Command: %08x", val);
+  // Resets touch the GP0 command state
+  gpu_sync(gpu);
+
+  LOG_OUTPUT(gpu->ctx, gpu->output_log_index, "GP1 Command: %08x", val);
 
   switch (opcode) {
     case 0x00:
@@ -731,117 +809,317 @@ void gpu_gp1(Gpu *gpu, uint32_t val) {
       fatal("Unhandled GP1 Command: 0x%08X", val);
   }
 
-  print_output_log(gpu->output_log_index);
+  print_output_log(gpu->ctx, gpu->output_log_index);
+}
+
+static inline bool is_top_left(Vec2 a, Vec2 b) {
+  int32_t dx = b[0] - a[0];
+  int32_t dy = b[1] - a[1];
+
+  // The triangle is wound so that left edges go down and top edges go left
+  return dy > 0 || (dy == 0 && dx < 0);
+}
+
+static EdgeStep edge_step(Vec2 a, Vec2 b, int32_t x, int32_t y) {
+  EdgeStep step;
+  Vec2 p = {x, y};
+
+  step.dx = b[1] - a[1];
+  step.dy = a[0] - b[0];
+  step.row = edge_func(a, b, p) - (is_top_left(a, b) ? 0 : 1);
+
+  return step;
 }
 
-void gpu_draw_tri(Gpu *gpu) {
+// Gradients of the attribute with vertex values `c`, starting at (x, y)
+static AttrStep attr_step(Vec2 *pos, int32_t const c[3], int32_t area, int32_t x, int32_t y) {
+  AttrStep step;
+
+  int64_t nx = (int64_t)(pos[2][1] - pos[1][1]) * c[0]
+    + (int64_t)(pos[0][1] - pos[2][1]) * c[1]
+    + (int64_t)(pos[1][1] - pos[0][1]) * c[2];
+  int64_t ny = (int64_t)(pos[1][0] - pos[2][0]) * c[0]
+    + (int64_t)(pos[2][0] - pos[0][0]) * c[1]
+    + (int64_t)(pos[0][0] - pos[1][0]) * c[2];
+
+  step.dx = (uint32_t)(nx * 0x10000 / area);
+  step.dy = (uint32_t)(ny * 0x10000 / area);
+  step.row = ((uint32_t)c[0] << 16) + 0x8000
+    + step.dx * (uint32_t)(x - pos[0][0])
+    + step.dy * (uint32_t)(y - pos[0][1]);
+
+  return step;
+}
+
+// Narrows [*start, *end] to the pixels where the edge function, `w` at
+// `x_min`, isn't negative. Leaves *end < *start if there are none.
+static inline void clip_span_to_edge(int32_t w, int32_t dx, int32_t x_min, int32_t *start, int32_t *end) {
+  if (dx > 0) {
+    if (w < 0) {
+      int32_t first = x_min + (-w + dx - 1) / dx;
+      if (first > *start)
+        *start = first;
+    }
+  } else if (w < 0)
+    *end = *start - 1;
+  else if (dx < 0) {
+    int32_t last = x_min + w / -dx;
+    if (last < *end)
+      *end = last;
+  }
+}
+
+static inline void swap_vec2(Vec2 a, Vec2 b) {
+  Vec2 tmp = {a[0], a[1]};
+  memcpy(a, b, sizeof(Vec2));
+  memcpy(b, tmp, sizeof(Vec2));
+}
+
+static inline void swap_vec3(Vec3 a, Vec3 b) {
+  Vec3 tmp = {a[0], a[1], a[2]};
+  memcpy(a, b, sizeof(Vec3));
+  memcpy(b, tmp, sizeof(Vec3));
+}
+
+static bool setup_tri(Gpu *gpu, GpuPrim *prim) {
   GpuRenderer *renderer = &gpu->renderer;
+  Vec2 *pos = renderer->tri_pos;
+
+  for (int i=0; i<3; i++) {
+    pos[i][0] += gpu->drawing_x_offset;
+    pos[i][1] += gpu->drawing_y_offset;
+  }
 
   for (int i=0; i<3; i++) {
-    renderer->tri_pos[i][0] += gpu->drawing_x_offset;
-    renderer->tri_pos[i][1] += gpu->drawing_y_offset;
+    int32_t dx = abs(pos[(i + 1) % 3][0] - pos[i][0]);
+    int32_t dy = abs(pos[(i + 1) % 3][1] - pos[i][1]);
+    if (dx > MAX_TRI_WIDTH || dy > MAX_TRI_HEIGHT)
+      return false;
   }
 
-  float area = edge_func(renderer->tri_pos[0], renderer->tri_pos[1], renderer->tri_pos[2]);
+  int32_t area = edge_func(pos[0], pos[1], pos[2]);
+  if (area == 0)
+    return false;
   if (area < 0) {
-    Vec2 tmp = {renderer->tri_pos[1][0], renderer->tri_pos[1][1]};
-    memcpy(renderer->tri_pos[1], renderer->tri_pos[2], sizeof renderer->tri_pos[1]);
-    memcpy(renderer->tri_pos[2], tmp, sizeof renderer->tri_pos[2]);
-    tmp[0] = renderer->tri_tex[1][0];
-    tmp[1] = renderer->tri_tex[1][1];
-    memcpy(renderer->tri_tex[1], renderer->tri_tex[2], sizeof renderer->tri_tex[1]);
-    memcpy(renderer->tri_tex[2], tmp, sizeof renderer->tri_tex[2]);
+    swap_vec2(pos[1], pos[2]);
+    swap_vec3(renderer->tri_color[1], renderer->tri_color[2]);
+    swap_vec2(renderer->tri_tex[1], renderer->tri_tex[2]);
     area *= -1;
   }
 
-  uint16_t bound_x_min = max(gpu->drawing_area_left, min(min(renderer->tri_pos[0][0], renderer->tri_pos[1][0]), renderer->tri_pos[2][0]));
-  uint16_t bound_x_max = min(gpu->drawing_area_right, max(max(renderer->tri_pos[0][0], renderer->tri_pos[1][0]), renderer->tri_pos[2][0]));
-  uint16_t bound_y_min = max(gpu->drawing_area_top, min(min(renderer->tri_pos[0][1], renderer->tri_pos[1][1]), renderer->tri_pos[2][1]));
-  uint16_t bound_y_max = min(gpu->drawing_area_bottom, max(max(renderer->tri_pos[0][1], renderer->tri_pos[1][1]), renderer->tri_pos[2][1]));
-
-  for(uint16_t i = bound_x_min; i <= bound_x_max; i++) {
-    for(uint16_t j = bound_y_min; j <= bound_y_max; j++) {
-      Vec2 p = {i + 0.5f, j + 0.5f};
-      float w0 = edge_func(renderer->tri_pos[1], renderer->tri_pos[2], p);
-      float w1 = edge_func(renderer->tri_pos[2], renderer->tri_pos[0], p);
-      float w2 = edge_func(renderer->tri_pos[0], renderer->tri_pos[1], p);
-      if (w0 >= 0 && w1 >= 0 && w2 >= 0) {
-        w0 /= area;
-        w1 /= area;
-        w2 /= area;
-
-        Vec3 shaded_color = {
-          w0 * renderer->tri_color[0][0] + w1 * renderer->tri_color[1][0] + w2 * renderer->tri_color[2][0],
-          w0 * renderer->tri_color[0][1] + w1 * renderer->tri_color[1][1] + w2 * renderer->tri_color[2][1],
-          w0 * renderer->tri_color[0][2] + w1 * renderer->tri_color[1][2] + w2 * renderer->tri_color[2][2]
-        };
-        Vec2 interop_tex = {
-          w0 * renderer->tri_tex[0][0] + w1 * renderer->tri_tex[1][0] + w2 * renderer->tri_tex[2][0],
-          w0 * renderer->tri_tex[0][1] + w1 * renderer->tri_tex[1][1] + w2 * renderer->tri_tex[2][1],
-        };
-
-        uint16_t *target = get_vram(renderer, i, j);
-        uint16_t new_color;
-        switch (gpu->blend_mode) {
-          case GpuNoTexture:
-            *target = vec_to_555(shaded_color);
-            break;
-          case GpuBlendedTexture:
-            new_color = multiply_888_555(vec_to_888(shaded_color), get_texel(gpu, interop_tex[0], interop_tex[1], gpu->texture_depth));
-            if (new_color)
-              *target = new_color;
-            break;
-          case GpuRawTexture:
-            new_color = get_texel(gpu, interop_tex[0], interop_tex[1], gpu->texture_depth);
-            if (new_color)
-              *target = new_color;
-            break;
-        }
-      }
+  int32_t x_min = pos[0][0], x_max = pos[0][0];
+  int32_t y_min = pos[0][1], y_max = pos[0][1];
+  for (int i=1; i<3; i++) {
+    if (pos[i][0] < x_min) x_min = pos[i][0];
+    if (pos[i][0] > x_max) x_max = pos[i][0];
+    if (pos[i][1] < y_min) y_min = pos[i][1];
+    if (pos[i][1] > y_max) y_max = pos[i][1];
+  }
+  if (x_min < gpu->drawing_area_left) x_min = gpu->drawing_area_left;
+  if (x_max > gpu->drawing_area_right) x_max = gpu->drawing_area_right;
+  if (y_min < gpu->drawing_area_top) y_min = gpu->drawing_area_top;
+  if (y_max > gpu->drawing_area_bottom) y_max = gpu->drawing_area_bottom;
+  if (x_max >= VRAM_WIDTH) x_max = VRAM_WIDTH - 1;
+  if (y_max >= VRAM_HEIGHT) y_max = VRAM_HEIGHT - 1;
+  if (x_min > x_max || y_min > y_max)
+    return false;
+
+  prim->render_mode = GpuRenderTri;
+  prim->left = x_min;
+  prim->top = y_min;
+  prim->right = x_max;
+  prim->bottom = y_max;
+
+  prim->edges[0] = edge_step(pos[1], pos[2], x_min, y_min);
+  prim->edges[1] = edge_step(pos[2], pos[0], x_min, y_min);
+  prim->edges[2] = edge_step(pos[0], pos[1], x_min, y_min);
+
+  // r, g, b, u, v
+  for (int k=0; k<3; k++) {
+    int32_t c[3] = {renderer->tri_color[0][k], renderer->tri_color[1][k], renderer->tri_color[2][k]};
+    prim->attrs[k] = attr_step(pos, c, area, x_min, y_min);
+  }
+  for (int k=0; k<2; k++) {
+    int32_t c[3] = {renderer->tri_tex[0][k], renderer->tri_tex[1][k], renderer->tri_tex[2][k]};
+    prim->attrs[3 + k] = attr_step(pos, c, area, x_min, y_min);
+  }
+
+  return true;
+}
+
+static void draw_tri(Gpu *gpu, GpuPrim const *prim, int32_t left, int32_t top, int32_t right, int32_t bottom) {
+  EdgeStep edges[3];
+  AttrStep attrs[5];
+  memcpy(edges, prim->edges, sizeof edges);
+  memcpy(attrs, prim->attrs, sizeof attrs);
+
+  TriSpan span;
+  for (int i=0; i<3; i++)
+    span.dx[SpanW0 + i] = edges[i].dx;
+  for (int i=0; i<5; i++)
+    span.dx[SpanR + i] = attrs[i].dx;
+
+  for (int i=0; i<3; i++)
+    edges[i].row += edges[i].dy * (top - prim->top);
+  for (int i=0; i<5; i++)
+    attrs[i].row += attrs[i].dy * (uint32_t)(top - prim->top);
+
+  // Each row only visits the pixels between the triangle's edges
+  for (int32_t y = top; y <= bottom; y++) {
+    int32_t start = left;
+    int32_t end = right;
+    for (int i=0; i<3; i++)
+      clip_span_to_edge(edges[i].row, edges[i].dx, prim->left, &start, &end);
+
+    if (start <= end) {
+      span.target = get_vram(&gpu->renderer, start, y);
+      span.count = end - start + 1;
+      for (int i=0; i<3; i++)
+        span.value[SpanW0 + i] = edges[i].row + edges[i].dx * (start - prim->left);
+      for (int i=0; i<5; i++)
+        span.value[SpanR + i] = attrs[i].row + attrs[i].dx * (uint32_t)(start - prim->left);
+
+      gpu->renderer.kernels->tri_span(gpu, &span);
     }
+
+    for (int i=0; i<3; i++)
+      edges[i].row += edges[i].dy;
+    for (int i=0; i<5; i++)
+      attrs[i].row += attrs[i].dy;
   }
 }
 
-void gpu_draw_rect(Gpu *gpu) {
+static bool setup_rect(Gpu *gpu, GpuPrim *prim) {
   GpuRenderer *renderer = &gpu->renderer;
 
   renderer->rect_pos[0] += gpu->drawing_x_offset;
   renderer->rect_pos[1] += gpu->drawing_y_offset;
 
-  uint16_t right = renderer->rect_pos[0] + renderer->rect_size[0];
-  uint16_t bottom = renderer->rect_pos[1] + renderer->rect_size[1];
-
-  for(uint16_t i = renderer->rect_pos[0]; i < right; i++) {
-    for(uint16_t j = renderer->rect_pos[1]; j < bottom; j++) {
-      Vec2 interop_tex = {
-        renderer->rect_tex[0] + (i - renderer->rect_pos[0]),
-        renderer->rect_tex[1] + (j - renderer->rect_pos[1])
-      };
-
-      uint16_t *target = get_vram(renderer, i, j);
-      uint16_t new_color;
-      if (gpu->blend_mode == GpuNoTexture)
-        *target = vec_to_555(renderer->rect_color);
-      else {
-        new_color = get_texel(gpu, interop_tex[0], interop_tex[1], gpu->texture_depth);
-        if (new_color)
-          *target = new_color;
-      }
-    }
+  int32_t left = renderer->rect_pos[0];
+  int32_t top = renderer->rect_pos[1];
+  int32_t right = left + renderer->rect_size[0];
+  int32_t bottom = top + renderer->rect_size[1];
+
+  // Keeps the spans inside VRAM
+  if (left < 0) left = 0;
+  if (top < 0) top = 0;
+  if (right > VRAM_WIDTH) right = VRAM_WIDTH;
+  if (bottom > VRAM_HEIGHT) bottom = VRAM_HEIGHT;
+  if (left >= right || top >= bottom)
+    return false;
+
+  prim->render_mode = GpuRenderRect;
+  prim->left = left;
+  prim->top = top;
+  prim->right = right - 1;
+  prim->bottom = bottom - 1;
+  prim->color = vec_to_555(renderer->rect_color);
+  prim->u = renderer->rect_tex[0] + (left - renderer->rect_pos[0]);
+  prim->v = renderer->rect_tex[1] + (top - renderer->rect_pos[1]);
+
+  return true;
+}
+
+static void draw_rect(Gpu *gpu, GpuPrim const *prim, int32_t left, int32_t top, int32_t right, int32_t bottom) {
+  RectSpan span;
+  span.count = right - left + 1;
+  span.color = prim->color;
+  span.u = prim->u + (left - prim->left);
+
+  for (int32_t y = top; y <= bottom; y++) {
+    span.target = get_vram(&gpu->renderer, left, y);
+    span.v = prim->v + (y - prim->top);
+    gpu->renderer.kernels->rect_span(gpu, &span);
   }
 }
 
-void gpu_draw(Gpu *gpu) {
+bool gpu_setup_prim(Gpu *gpu, GpuPrim *prim) {
+  bool visible = false;
+
   switch (gpu->renderer.render_mode) {
     case GpuRenderTri:
-      gpu_draw_tri(gpu);
+      visible = setup_tri(gpu, prim);
       break;
     case GpuRenderRect:
-      gpu_draw_rect(gpu);
+      visible = setup_rect(gpu, prim);
       break;
   }
+
+  if (visible)
+    mark_vram_rows(&gpu->renderer, prim->top, prim->bottom + 1);
+
+  return visible;
+}
+
+void gpu_draw_prim(Gpu *gpu, GpuPrim const *prim, int32_t left, int32_t top, int32_t right, int32_t bottom) {
+  if (left < prim->left) left = prim->left;
+  if (top < prim->top) top = prim->top;
+  if (right > prim->right) right = prim->right;
+  if (bottom > prim->bottom) bottom = prim->bottom;
+  if (left > right || top > bottom)
+    return;
+
+  switch (prim->render_mode) {
+    case GpuRenderTri:
+      draw_tri(gpu, prim, left, top, right, bottom);
+      break;
+    case GpuRenderRect:
+      draw_rect(gpu, prim, left, top, right, bottom);
+      break;
+  }
+}
+
+void gpu_submit_prim(Gpu *gpu, GpuPrim const *prim) {
+  if (gpu->tiles)
+    gpu_tiles_bin(gpu->tiles, gpu, prim);
+  else
+    gpu_draw_prim(gpu, prim, prim->left, prim->top, prim->right, prim->bottom);
+}
+
+void gpu_draw(Gpu *gpu) {
+  GpuPrim prim;
+
+  if (gpu_setup_prim(gpu, &prim))
+    gpu_submit_prim(gpu, &prim);
+}
+
+void gpu_start_thread(Gpu *gpu, uint32_t workers) {
+  if (gpu->thread)
+    return;
+
+  if (workers > 0)
+    gpu->tiles = init_gpu_tiles(workers);
+  gpu->thread = init_gpu_thread(gpu);
+}
+
+void gpu_stop_thread(Gpu *gpu) {
+  if (gpu->thread == NULL)
+    return;
+
+  destroy_gpu_thread(gpu->thread);
+  gpu->thread = NULL;
+  if (gpu->tiles) {
+    destroy_gpu_tiles(gpu->tiles);
+    gpu->tiles = NULL;
+  }
+}
+
+void gpu_flush(Gpu *gpu) {
+  if (gpu->tiles)
+    gpu_tiles_flush(gpu->tiles);
+}
+
+void gpu_sync(Gpu *gpu) {
+  if (gpu->thread)
+    gpu_thread_sync(gpu->thread);
+}
+
+void gpu_present(Gpu *gpu) {
+  gpu_sync(gpu);
+  renderer_update_window(&gpu->renderer);
 }
 
 void destroy_gpu(Gpu *gpu) {
+  gpu_stop_thread(gpu);
   destroy_renderer(&gpu->renderer);
 }
@@ -0,0 +1,154 @@
+#include <stdlib.h>
+
+#include "gpu_thread.h"
+#include "gpu_tiles.h"
+#include "log.h"
+
+static void *gpu_thread_main(void *arg);
+
+// True once a ring index has reached `target`, allowing for wrapping
+static inline bool index_reached(uint32_t index, uint32_t target) {
+  return (int32_t)(index - target) >= 0;
+}
+
+GpuThread *init_gpu_thread(Gpu *gpu) {
+  GpuThread *thread = malloc(sizeof(GpuThread));
+  if (thread == NULL)
+    fatal("MemoryError: Couldn't allocate the GPU command ring");
+
+  thread->gpu = gpu;
+  atomic_init(&thread->head, 0);
+  atomic_init(&thread->producer_waiting, false);
+  atomic_init(&thread->quit, false);
+  atomic_init(&thread->tail, 0);
+  atomic_init(&thread->done, 0);
+  atomic_init(&thread->consumer_waiting, false);
+  pthread_mutex_init(&thread->lock, NULL);
+  pthread_cond_init(&thread->wake, NULL);
+  pthread_cond_init(&thread->progress, NULL);
+  if (pthread_create(&thread->thread, NULL, gpu_thread_main, thread) != 0)
+    fatal("ThreadError: Couldn't start the GPU thread");
+
+  return thread;
+}
+
+// Sleeps the CPU thread until `index`, the tail or done, has reached
+// `target`. The render thread checks `producer_waiting` after every
+// batch and before it sleeps.
+static void wait_for_index(GpuThread *thread, _Atomic uint32_t *index, uint32_t target) {
+  atomic_store(&thread->producer_waiting, true);
+
+  pthread_mutex_lock(&thread->lock);
+  // It might be asleep with primitives left to draw
+  pthread_cond_signal(&thread->wake);
+  while (!index_reached(atomic_load(index), target))
+    pthread_cond_wait(&thread->progress, &thread->lock);
+  pthread_mutex_unlock(&thread->lock);
+
+  atomic_store_explicit(&thread->producer_waiting, false, memory_order_relaxed);
+}
+
+// True if the CPU thread waits for words that are taken but not drawn
+static inline bool sync_pending(GpuThread *thread, uint32_t tail) {
+  return atomic_load(&thread->producer_waiting) && atomic_load_explicit(&thread->done, memory_order_relaxed) != tail;
+}
+
+// Sleeps the render thread until a word past `tail` is pushed or the
+// CPU thread waits for a sync
+static void wait_for_words(GpuThread *thread, uint32_t tail) {
+  atomic_store(&thread->consumer_waiting, true);
+
+  pthread_mutex_lock(&thread->lock);
+  while (atomic_load(&thread->head) == tail && !atomic_load(&thread->quit) && !sync_pending(thread, tail))
+    pthread_cond_wait(&thread->wake, &thread->lock);
+  pthread_mutex_unlock(&thread->lock);
+
+  atomic_store_explicit(&thread->consumer_waiting, false, memory_order_relaxed);
+}
+
+void gpu_thread_push(GpuThread *thread, uint32_t word) {
+  uint32_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+
+  if (head - atomic_load_explicit(&thread->tail, memory_order_acquire) == GPU_THREAD_RING_SIZE)
+    wait_for_index(thread, &thread->tail, head - GPU_THREAD_RING_SIZE + 1);
+
+  thread->ring[head & GPU_THREAD_RING_MASK] = word;
+  // Sequentially consistent, so either the render thread sees the word
+  // before it sleeps or we see it waiting
+  atomic_store(&thread->head, head + 1);
+
+  if (atomic_load(&thread->consumer_waiting)) {
+    pthread_mutex_lock(&thread->lock);
+    pthread_cond_signal(&thread->wake);
+    pthread_mutex_unlock(&thread->lock);
+  }
+}
+
+void gpu_thread_sync(GpuThread *thread) {
+  uint32_t head = atomic_load_explicit(&thread->head, memory_order_relaxed);
+
+  if (atomic_load_explicit(&thread->done, memory_order_acquire) != head)
+    wait_for_index(thread, &thread->done, head);
+}
+
+// Draws the binned primitives and marks every taken word done
+static void publish(GpuThread *thread, uint32_t tail) {
+  gpu_flush(thread->gpu);
+  atomic_store(&thread->done, tail);
+
+  if (atomic_load(&thread->producer_waiting)) {
+    pthread_mutex_lock(&thread->lock);
+    pthread_cond_broadcast(&thread->progress);
+    pthread_mutex_unlock(&thread->lock);
+  }
+}
+
+static void *gpu_thread_main(void *arg) {
+  GpuThread *thread = arg;
+  Gpu *gpu = thread->gpu;
+  uint32_t tail = atomic_load_explicit(&thread->tail, memory_order_relaxed);
+
+  log_use(&gpu->ctx->logger);
+
+  while (1) {
+    uint32_t head = atomic_load_explicit(&thread->head, memory_order_acquire);
+
+    if (head == tail) {
+      if (sync_pending(thread, tail))
+        publish(thread, tail);
+      else if (atomic_load(&thread->quit))
+        break;
+      else
+        wait_for_words(thread, tail);
+      continue;
+    }
+
+    for (; tail != head; tail++) {
+      gpu_execute_gp0(gpu, thread->ring[tail & GPU_THREAD_RING_MASK]);
+      atomic_store_explicit(&thread->tail, tail + 1, memory_order_release);
+    }
+
+    // Binned primitives are left for a bigger batch unless the CPU
+    // thread is waiting. The fence pairs with the store in wait_for_index.
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&thread->producer_waiting, memory_order_relaxed) || gpu->tiles == NULL || gpu_tiles_empty(gpu->tiles))
+      publish(thread, tail);
+  }
+
+  return NULL;
+}
+
+void destroy_gpu_thread(GpuThread *thread) {
+  gpu_thread_sync(thread);
+
+  atomic_store(&thread->quit, true);
+  pthread_mutex_lock(&thread->lock);
+  pthread_cond_signal(&thread->wake);
+  pthread_mutex_unlock(&thread->lock);
+  pthread_join(thread->thread, NULL);
+
+  pthread_cond_destroy(&thread->progress);
+  pthread_cond_destroy(&thread->wake);
+  pthread_mutex_destroy(&thread->lock);
+  free(thread);
+}
@@ -0,0 +1,265 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "gpu_tiles.h"
+#include "log.h"
+
+static void *tile_worker(void *arg);
+
+GpuTiles *init_gpu_tiles(uint32_t workers) {
+  if (workers > GPU_TILE_MAX_WORKERS)
+    fatal("ArgError: At most %d GPU workers are supported", GPU_TILE_MAX_WORKERS);
+
+  GpuTiles *tiles = malloc(sizeof(GpuTiles));
+  if (tiles == NULL)
+    fatal("MemoryError: Couldn't allocate GPU tiles");
+
+  tiles->prims = malloc(GPU_TILE_MAX_PRIMS * sizeof(GpuTilePrim));
+  tiles->bins = malloc(GPU_TILE_COUNT * GPU_TILE_MAX_PRIMS * sizeof(uint16_t));
+  if (tiles->prims == NULL || tiles->bins == NULL)
+    fatal("MemoryError: Couldn't allocate GPU tiles");
+
+  tiles->prim_count = 0;
+  memset(tiles->bin_counts, 0, sizeof tiles->bin_counts);
+  tiles->used_count = 0;
+  memset(tiles->written, 0, sizeof tiles->written);
+  memset(tiles->read, 0, sizeof tiles->read);
+  atomic_init(&tiles->next_tile, 0);
+
+  tiles->generation = 0;
+  tiles->busy = 0;
+  tiles->quit = false;
+  pthread_mutex_init(&tiles->lock, NULL);
+  pthread_cond_init(&tiles->start, NULL);
+  pthread_cond_init(&tiles->done, NULL);
+  tiles->worker_count = workers;
+  for (uint32_t i = 0; i < workers; i++) {
+    if (pthread_create(&tiles->workers[i], NULL, tile_worker, tiles) != 0)
+      fatal("ThreadError: Couldn't start a GPU worker");
+  }
+
+  return tiles;
+}
+
+static inline bool areas_overlap(GpuArea const *a, GpuArea const *b) {
+  return a->left <= b->right && b->left <= a->right && a->top <= b->bottom && b->top <= a->bottom;
+}
+
+// The columns of tiles an area inside VRAM covers, as tile map bits
+static inline uint32_t tile_row_mask(GpuArea const *area) {
+  uint32_t first = area->left / GPU_TILE_WIDTH;
+  uint32_t last = area->right / GPU_TILE_WIDTH;
+
+  return (uint32_t)((2ull << last) - (1ull << first));
+}
+
+static void mark_tiles(GpuTileMap map, GpuArea const *area) {
+  uint32_t mask = tile_row_mask(area);
+
+  for (int32_t row = area->top / GPU_TILE_HEIGHT; row <= area->bottom / GPU_TILE_HEIGHT; row++)
+    map[row] |= mask;
+}
+
+static bool tiles_marked(GpuTileMap const map, GpuArea const *area) {
+  uint32_t mask = tile_row_mask(area);
+
+  for (int32_t row = area->top / GPU_TILE_HEIGHT; row <= area->bottom / GPU_TILE_HEIGHT; row++) {
+    if (map[row] & mask)
+      return true;
+  }
+
+  return false;
+}
+
+// The VRAM a textured primitive can read, as up to two areas: the
+// texels and the CLUT. Reads past the end of a VRAM row wrap to the
+// next one, so anything unusual is treated as reading all of VRAM.
+static uint32_t texture_areas(Gpu const *gpu, GpuPrim const *prim, GpuArea areas[2]) {
+  static GpuArea const all = {0, 0, VRAM_WIDTH - 1, VRAM_HEIGHT - 1};
+
+  if (gpu->blend_mode == GpuNoTexture)
+    return 0;
+
+  int32_t u_min, u_max, v_min, v_max;
+  if (prim->render_mode == GpuRenderTri) {
+    Vec2 const *tex = gpu->renderer.tri_tex;
+    u_min = u_max = tex[0][0];
+    v_min = v_max = tex[0][1];
+    for (int i = 1; i < 3; i++) {
+      if (tex[i][0] < u_min) u_min = tex[i][0];
+      if (tex[i][0] > u_max) u_max = tex[i][0];
+      if (tex[i][1] < v_min) v_min = tex[i][1];
+      if (tex[i][1] > v_max) v_max = tex[i][1];
+    }
+    // Rounding in the interpolation
+    u_min--, v_min--;
+    u_max++, v_max++;
+    if (u_min < 0) u_min = 0;
+    if (v_min < 0) v_min = 0;
+  } else {
+    u_min = (uint16_t)prim->u;
+    v_min = (uint16_t)prim->v;
+    u_max = u_min + (prim->right - prim->left);
+    v_max = v_min + (prim->bottom - prim->top);
+  }
+
+  int32_t shift = 0;
+  if (gpu->texture_depth == GpuTexture4Bits)
+    shift = 2;
+  else if (gpu->texture_depth == GpuTexture8Bits)
+    shift = 1;
+
+  areas[0] = (GpuArea) {
+    gpu->texture_page[0] + (u_min >> shift),
+    gpu->texture_page[1] + v_min,
+    gpu->texture_page[0] + (u_max >> shift),
+    gpu->texture_page[1] + v_max
+  };
+  if (areas[0].right >= VRAM_WIDTH || areas[0].bottom >= VRAM_HEIGHT) {
+    areas[0] = all;
+    return 1;
+  }
+
+  if (gpu->texture_depth == GpuTexture15Bits)
+    return 1;
+
+  int32_t clut_width = (gpu->texture_depth == GpuTexture4Bits) ? 16 : 256;
+  areas[1] = (GpuArea) {gpu->clut[0], gpu->clut[1], gpu->clut[0] + clut_width - 1, gpu->clut[1]};
+  if (areas[1].right >= VRAM_WIDTH || areas[1].bottom >= VRAM_HEIGHT)
+    areas[0] = areas[1] = all;
+
+  return 2;
+}
+
+void gpu_tiles_bin(GpuTiles *tiles, Gpu *gpu, GpuPrim const *prim) {
+  GpuArea area = {prim->left, prim->top, prim->right, prim->bottom};
+  GpuArea reads[2];
+  uint32_t read_count = texture_areas(gpu, prim, reads);
+
+  bool flush = tiles->prim_count == GPU_TILE_MAX_PRIMS || tiles_marked(tiles->read, &area);
+  bool feedback = false;
+  for (uint32_t i = 0; i < read_count; i++) {
+    flush |= tiles_marked(tiles->written, &reads[i]);
+    feedback |= areas_overlap(&reads[i], &area);
+  }
+
+  if (flush || feedback)
+    gpu_tiles_flush(tiles);
+
+  // A primitive reading what it draws depends on the order of its rows
+  if (feedback) {
+    gpu_draw_prim(gpu, prim, area.left, area.top, area.right, area.bottom);
+    return;
+  }
+
+  uint16_t index = tiles->prim_count++;
+  tiles->prims[index].gpu = *gpu;
+  tiles->prims[index].prim = *prim;
+
+  for (int32_t row = area.top / GPU_TILE_HEIGHT; row <= area.bottom / GPU_TILE_HEIGHT; row++) {
+    for (int32_t column = area.left / GPU_TILE_WIDTH; column <= area.right / GPU_TILE_WIDTH; column++) {
+      uint16_t tile = row * GPU_TILE_COLUMNS + column;
+      if (tiles->bin_counts[tile] == 0)
+        tiles->used[tiles->used_count++] = tile;
+      tiles->bins[tile * GPU_TILE_MAX_PRIMS + tiles->bin_counts[tile]++] = index;
+    }
+  }
+
+  mark_tiles(tiles->written, &area);
+  for (uint32_t i = 0; i < read_count; i++)
+    mark_tiles(tiles->read, &reads[i]);
+}
+
+// Draws used tiles until there are none left to take
+static void draw_tiles(GpuTiles *tiles) {
+  uint32_t index;
+
+  while ((index = atomic_fetch_add(&tiles->next_tile, 1)) < tiles->used_count) {
+    uint16_t tile = tiles->used[index];
+    int32_t left = (tile % GPU_TILE_COLUMNS) * GPU_TILE_WIDTH;
+    int32_t top = (tile / GPU_TILE_COLUMNS) * GPU_TILE_HEIGHT;
+    uint16_t const *bin = &tiles->bins[tile * GPU_TILE_MAX_PRIMS];
+
+    for (uint16_t i = 0; i < tiles->bin_counts[tile]; i++) {
+      GpuTilePrim *binned = &tiles->prims[bin[i]];
+      gpu_draw_prim(&binned->gpu, &binned->prim, left, top, left + GPU_TILE_WIDTH - 1, top + GPU_TILE_HEIGHT - 1);
+    }
+  }
+}
+
+void gpu_tiles_flush(GpuTiles *tiles) {
+  if (tiles->prim_count == 0)
+    return;
+
+  atomic_store(&tiles->next_tile, 0);
+
+  // Waking the workers costs more than a single tile takes to draw
+  if (tiles->worker_count == 0 || tiles->used_count == 1)
+    draw_tiles(tiles);
+  else {
+    pthread_mutex_lock(&tiles->lock);
+    tiles->generation++;
+    tiles->busy = tiles->worker_count;
+    pthread_cond_broadcast(&tiles->start);
+    pthread_mutex_unlock(&tiles->lock);
+
+    draw_tiles(tiles);
+
+    pthread_mutex_lock(&tiles->lock);
+    while (tiles->busy > 0)
+      pthread_cond_wait(&tiles->done, &tiles->lock);
+    pthread_mutex_unlock(&tiles->lock);
+  }
+
+  for (uint32_t i = 0; i < tiles->used_count; i++)
+    tiles->bin_counts[tiles->used[i]] = 0;
+  tiles->used_count = 0;
+  tiles->prim_count = 0;
+  memset(tiles->written, 0, sizeof tiles->written);
+  memset(tiles->read, 0, sizeof tiles->read);
+}
+
+static void *tile_worker(void *arg) {
+  GpuTiles *tiles = arg;
+  uint32_t generation = 0;
+
+  pthread_mutex_lock(&tiles->lock);
+  while (1) {
+    while (!tiles->quit && tiles->generation == generation)
+      pthread_cond_wait(&tiles->start, &tiles->lock);
+
+    if (tiles->quit)
+      break;
+
+    generation = tiles->generation;
+    pthread_mutex_unlock(&tiles->lock);
+
+    draw_tiles(tiles);
+
+    pthread_mutex_lock(&tiles->lock);
+    tiles->busy--;
+    if (tiles->busy == 0)
+      pthread_cond_signal(&tiles->done);
+  }
+  pthread_mutex_unlock(&tiles->lock);
+
+  return NULL;
+}
+
+void destroy_gpu_tiles(GpuTiles *tiles) {
+  gpu_tiles_flush(tiles);
+
+  pthread_mutex_lock(&tiles->lock);
+  tiles->quit = true;
+  pthread_cond_broadcast(&tiles->start);
+  pthread_mutex_unlock(&tiles->lock);
+  for (uint32_t i = 0; i < tiles->worker_count; i++)
+    pthread_join(tiles->workers[i], NULL);
+
+  pthread_cond_destroy(&tiles->done);
+  pthread_cond_destroy(&tiles->start);
+  pthread_mutex_destroy(&tiles->lock);
+  free(tiles->bins);
+  free(tiles->prims);
+  free(tiles);
+}
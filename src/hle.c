@@ -0,0 +1,284 @@
+#include <stdio.h>
+
+#include "hle.h"
+#include "cpu.h"
+
+typedef uint32_t (*HleFn)(Cpu *cpu, uint32_t const *args);
+
+typedef struct HleEntry {
+  char const *name;
+  HleFn fn;
+  bool enabled_by_default;
+} HleEntry;
+
+static inline uint8_t read8(Cpu *cpu, uint32_t addr) {
+  return load(&cpu->inter, &cpu->shared, MAKE_Addr(addr), AddrByte);
+}
+
+static inline void write8(Cpu *cpu, uint32_t addr, uint8_t val) {
+  store(&cpu->inter, &cpu->shared, MAKE_Addr(addr), val, AddrByte);
+}
+
+static uint32_t hle_memcpy(Cpu *cpu, uint32_t const *args) {
+  uint32_t dst = args[0], src = args[1];
+  int32_t len = args[2];
+
+  if (dst == 0 || src == 0)
+    return 0;
+
+  for (int32_t index = 0; index < len; index++)
+    write8(cpu, dst + index, read8(cpu, src + index));
+
+  return dst;
+}
+
+static uint32_t hle_memset(Cpu *cpu, uint32_t const *args) {
+  uint32_t dst = args[0];
+  int32_t len = args[2];
+
+  if (dst == 0)
+    return 0;
+
+  for (int32_t index = 0; index < len; index++)
+    write8(cpu, dst + index, args[1]);
+
+  return dst;
+}
+
+static uint32_t hle_memmove(Cpu *cpu, uint32_t const *args) {
+  uint32_t dst = args[0], src = args[1];
+  int32_t len = args[2];
+
+  if (dst == 0 || src == 0)
+    return 0;
+
+  if (dst > src) {
+    for (int32_t index = len - 1; index >= 0; index--)
+      write8(cpu, dst + index, read8(cpu, src + index));
+  } else {
+    for (int32_t index = 0; index < len; index++)
+      write8(cpu, dst + index, read8(cpu, src + index));
+  }
+
+  return dst;
+}
+
+static uint32_t hle_memcmp(Cpu *cpu, uint32_t const *args) {
+  int32_t len = args[2];
+
+  for (int32_t index = 0; index < len; index++) {
+    int32_t diff = read8(cpu, args[0] + index) - read8(cpu, args[1] + index);
+    if (diff)
+      return diff;
+  }
+
+  return 0;
+}
+
+static uint32_t hle_strlen(Cpu *cpu, uint32_t const *args) {
+  uint32_t len = 0;
+
+  if (args[0] == 0)
+    return 0;
+
+  while (read8(cpu, args[0] + len))
+    len++;
+
+  return len;
+}
+
+static uint32_t strncmp_guest(Cpu *cpu, uint32_t s1, uint32_t s2, uint32_t len) {
+  if (s1 == 0 || s2 == 0)
+    return (s1 == s2) ? 0 : (s1 ? 1 : -1);
+
+  for (uint32_t index = 0; index < len; index++) {
+    uint8_t c1 = read8(cpu, s1 + index);
+    uint8_t c2 = read8(cpu, s2 + index);
+
+    if (c1 != c2)
+      return c1 - c2;
+    if (c1 == 0)
+      break;
+  }
+
+  return 0;
+}
+
+static uint32_t hle_strcmp(Cpu *cpu, uint32_t const *args) {
+  return strncmp_guest(cpu, args[0], args[1], UINT32_MAX);
+}
+
+static uint32_t hle_strncmp(Cpu *cpu, uint32_t const *args) {
+  return strncmp_guest(cpu, args[0], args[1], args[2]);
+}
+
+static uint32_t hle_strcpy(Cpu *cpu, uint32_t const *args) {
+  uint32_t dst = args[0], src = args[1];
+
+  if (dst == 0 || src == 0)
+    return 0;
+
+  for (uint32_t index = 0;; index++) {
+    uint8_t c = read8(cpu, src + index);
+    write8(cpu, dst + index, c);
+    if (c == 0)
+      break;
+  }
+
+  return dst;
+}
+
+static uint32_t hle_toupper(Cpu *cpu, uint32_t const *args) {
+  uint8_t c = args[0];
+
+  return (c >= 'a' && c <= 'z') ? c - 'a' + 'A' : c;
+}
+
+static uint32_t hle_tolower(Cpu *cpu, uint32_t const *args) {
+  uint8_t c = args[0];
+
+  return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+static uint32_t hle_putchar(Cpu *cpu, uint32_t const *args) {
+  putchar(args[0]);
+
+  return args[0];
+}
+
+// No devices are emulated, so only writes to stdout go anywhere
+static uint32_t hle_open(Cpu *cpu, uint32_t const *args) {
+  return -1;
+}
+
+static uint32_t hle_lseek(Cpu *cpu, uint32_t const *args) {
+  return -1;
+}
+
+static uint32_t hle_read(Cpu *cpu, uint32_t const *args) {
+  return -1;
+}
+
+static uint32_t hle_write(Cpu *cpu, uint32_t const *args) {
+  if (args[0] != 1)
+    return -1;
+
+  for (uint32_t index = 0; index < args[2]; index++)
+    putchar(read8(cpu, args[1] + index));
+
+  return args[2];
+}
+
+static uint32_t hle_close(Cpu *cpu, uint32_t const *args) {
+  return args[0];
+}
+
+// Events never fire, so waiting succeeds immediately and polling never does
+static uint32_t hle_open_event(Cpu *cpu, uint32_t const *args) {
+  return 0xF1000000 | (cpu->hle.next_event++ & 0xFFFF);
+}
+
+static uint32_t hle_test_event(Cpu *cpu, uint32_t const *args) {
+  return 0;
+}
+
+static uint32_t hle_open_thread(Cpu *cpu, uint32_t const *args) {
+  return 0xFF000000 | (cpu->hle.next_thread++ & 0xFFFF);
+}
+
+static uint32_t hle_success(Cpu *cpu, uint32_t const *args) {
+  return 1;
+}
+
+static HleEntry const a0_functions[HLE_FUNC_COUNT] = {
+  [0x00] = {"open", hle_open, false},
+  [0x01] = {"lseek", hle_lseek, false},
+  [0x02] = {"read", hle_read, false},
+  [0x03] = {"write", hle_write, false},
+  [0x04] = {"close", hle_close, false},
+  [0x17] = {"strcmp", hle_strcmp, true},
+  [0x18] = {"strncmp", hle_strncmp, true},
+  [0x19] = {"strcpy", hle_strcpy, true},
+  [0x1B] = {"strlen", hle_strlen, true},
+  [0x25] = {"toupper", hle_toupper, true},
+  [0x26] = {"tolower", hle_tolower, true},
+  [0x2A] = {"memcpy", hle_memcpy, true},
+  [0x2B] = {"memset", hle_memset, true},
+  [0x2C] = {"memmove", hle_memmove, true},
+  [0x2D] = {"memcmp", hle_memcmp, true},
+  [0x3C] = {"putchar", hle_putchar, true}
+};
+
+static HleEntry const b0_functions[HLE_FUNC_COUNT] = {
+  [0x08] = {"OpenEvent", hle_open_event, false},
+  [0x09] = {"CloseEvent", hle_success, false},
+  [0x0A] = {"WaitEvent", hle_success, false},
+  [0x0B] = {"TestEvent", hle_test_event, false},
+  [0x0C] = {"EnableEvent", hle_success, false},
+  [0x0D] = {"DisableEvent", hle_success, false},
+  [0x0E] = {"OpenThread", hle_open_thread, false},
+  [0x0F] = {"CloseThread", hle_success, false},
+  [0x10] = {"ChangeThread", hle_success, false},
+  [0x32] = {"open", hle_open, false},
+  [0x33] = {"lseek", hle_lseek, false},
+  [0x34] = {"read", hle_read, false},
+  [0x35] = {"write", hle_write, false},
+  [0x36] = {"close", hle_close, false},
+  [0x3B] = {"putc", hle_putchar, true},
+  [0x3D] = {"putchar", hle_putchar, true}
+};
+
+// The C0 functions all manage kernel internals (exception handlers,
+// device tables), which can't be replaced without an HLE kernel
+static HleEntry const c0_functions[HLE_FUNC_COUNT] = {0};
+
+static HleEntry const *const hle_tables[HLE_VECTOR_COUNT] = {
+  [HleA0] = a0_functions,
+  [HleB0] = b0_functions,
+  [HleC0] = c0_functions
+};
+
+Hle init_hle() {
+  Hle hle;
+
+  for (size_t vector = 0; vector < HLE_VECTOR_COUNT; vector++) {
+    for (size_t func = 0; func < HLE_FUNC_COUNT; func++)
+      hle.enabled[vector][func] = hle_tables[vector][func].enabled_by_default;
+  }
+  hle.next_event = 0;
+  hle.next_thread = 0;
+
+  return hle;
+}
+
+void hle_set_enabled(Hle *hle, HleVector vector, uint8_t func, bool enabled) {
+  hle->enabled[vector][func] = enabled && hle_tables[vector][func].fn;
+}
+
+void hle_disable_all(Hle *hle) {
+  for (size_t vector = 0; vector < HLE_VECTOR_COUNT; vector++) {
+    for (size_t func = 0; func < HLE_FUNC_COUNT; func++)
+      hle->enabled[vector][func] = false;
+  }
+}
+
+bool hle_call(Cpu *cpu, HleVector vector) {
+  uint8_t func = cpu->regs[9];
+
+  if (!cpu->hle.enabled[vector][func])
+    return false;
+
+  // Behave like an instruction ran: commit the pending load first
+  delayed_load(cpu);
+  tick(&cpu->shared.clock, MAKE_Cycles(CYCLES_PER_INS));
+
+  uint32_t args[4] = {cpu->regs[4], cpu->regs[5], cpu->regs[6], cpu->regs[7]};
+  cpu->regs[2] = hle_tables[vector][func].fn(cpu, args);
+
+  cpu->pc = MAKE_Addr(cpu->regs[31]);
+  cpu->next_pc = MAKE_Addr(cpu->pc.data + 4);
+  cpu->branch = false;
+  cpu->delay_slot = false;
+
+  return true;
+}
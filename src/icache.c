@@ -0,0 +1,73 @@
+#include "icache.h"
+
+ICache init_icache() {
+  ICache icache = {0};
+
+  return icache;
+}
+
+static inline ICacheLine *icache_line(ICache *icache, Addr addr) {
+  return &icache->lines[(addr.data >> 4) % ICACHE_LINE_COUNT];
+}
+
+static inline uint32_t icache_word(Addr addr) {
+  return (addr.data >> 2) % ICACHE_LINE_WORDS;
+}
+
+// KUSEG and KSEG0 are cached, KSEG1 isn't
+static inline bool is_cached(Addr addr) {
+  return addr.data < 0xA0000000;
+}
+
+void icache_fill(ICache *icache, Addr addr, uint32_t word) {
+  if (!is_cached(addr) || !(icache->control & CACHE_CONTROL_ICACHE_ENABLE))
+    return;
+
+  ICacheLine *line = icache_line(icache, addr);
+  uint32_t tag = mask_region(addr).data & ~0xF;
+
+  if (line->tag != tag) {
+    line->tag = tag;
+    line->valid = 0;
+  }
+
+  line->data[icache_word(addr)] = word;
+  line->valid |= 1 << icache_word(addr);
+}
+
+uint32_t icache_load(ICache *icache, Addr addr, AddrType type) {
+  uint32_t word = icache_line(icache, addr)->data[icache_word(addr)];
+  uint32_t shift = (addr.data & 3) * 8;
+
+  switch (type) {
+    case AddrByte:
+      return (word >> shift) & 0xFF;
+    case AddrHalf:
+      return (word >> shift) & 0xFFFF;
+    default:
+      return word;
+  }
+}
+
+static inline void drop_decoded(ICacheLine *line, CodeCache *code_cache, uint32_t index) {
+  if ((line->valid & (1 << index)) && line->tag < range(RAM).size)
+    code_cache_invalidate(code_cache, MAKE_Addr(line->tag + 4 * index));
+
+  line->valid &= ~(1 << index);
+}
+
+// A store while the cache is isolated. In tag test mode it invalidates
+// the whole line, otherwise it replaces a single word. Either way the
+// decoded instructions the old contents stood for are dropped too.
+void icache_store(ICache *icache, CodeCache *code_cache, Addr addr, uint32_t val) {
+  ICacheLine *line = icache_line(icache, addr);
+
+  if (icache->control & CACHE_CONTROL_TAG_TEST) {
+    for (uint32_t index = 0; index < ICACHE_LINE_WORDS; index++)
+      drop_decoded(line, code_cache, index);
+    return;
+  }
+
+  drop_decoded(line, code_cache, icache_word(addr));
+  line->data[icache_word(addr)] = val;
+}
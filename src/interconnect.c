@@ -5,31 +5,80 @@
 #include "log.h"
 #include "output_logger.h"
 #include "flag.h"
+#include "byteorder.h"
 
-Interconnect init_interconnect(char const *bios_filename) {
+Interconnect init_interconnect(Context *ctx, char const *bios_filename) {
   Interconnect inter = {0};
 
+  inter.ctx = ctx;
+
   inter.bios = init_bios(bios_filename);
   inter.ram = init_ram();
   inter.dma = init_dma();
-  inter.gpu = init_gpu();
+  inter.gpu = init_gpu(ctx);
   inter.timers = init_timers();
   inter.pad = init_scratchpad();
-  inter.output_log_index = init_output_log();
+  inter.code_cache = init_code_cache();
+  inter.icache = init_icache();
+  inter.read_pages = calloc(MEM_PAGE_COUNT, sizeof(uint8_t *));
+  inter.write_pages = calloc(MEM_PAGE_COUNT, sizeof(uint8_t *));
+  if (inter.read_pages == NULL || inter.write_pages == NULL)
+    fatal("MemoryError: Couldn't allocate memory map");
+  inter.output_log_index = init_output_log(ctx);
+
+  for (uint32_t offset = 0; offset < range(RAM).size; offset += MEM_PAGE_SIZE) {
+    uint8_t *host = ram_host_ptr(&inter.ram, offset);
+    inter.read_pages[(range(RAM).start + offset) >> MEM_PAGE_SHIFT] = host;
+    inter.write_pages[(range(RAM).start + offset) >> MEM_PAGE_SHIFT] = host;
+  }
+
+  for (uint32_t offset = 0; offset < range(BIOS).size; offset += MEM_PAGE_SIZE)
+    inter.read_pages[(range(BIOS).start + offset) >> MEM_PAGE_SHIFT] = inter.bios.data + offset;
+
+  // Only the first 1KB of the page is mapped, see past_scratchpad
+  inter.read_pages[range(SCRATCH_PAD).start >> MEM_PAGE_SHIFT] = inter.pad.data;
+  inter.write_pages[range(SCRATCH_PAD).start >> MEM_PAGE_SHIFT] = inter.pad.data;
 
   return inter;
 }
 
-uint32_t load(Interconnect *inter, SharedState *shared, Addr addr, AddrType type) {
-  addr = mask_region(addr);
+static inline uint32_t load_host(uint8_t const *ptr, AddrType type) {
+  switch (type) {
+    case AddrByte:
+      return ptr[0];
+    case AddrHalf:
+      return read_le16(ptr);
+    default:
+      return read_le32(ptr);
+  }
+}
 
-  int32_t offset = range_contains(range(BIOS), addr);
-  if (offset >= 0)
-    return load_bios(&inter->bios, MAKE_Addr(offset), type);
+static inline void store_host(uint8_t *ptr, uint32_t val, AddrType type) {
+  switch (type) {
+    case AddrByte:
+      ptr[0] = val;
+      break;
+    case AddrHalf:
+      write_le16(ptr, val);
+      break;
+    case AddrWord:
+      write_le32(ptr, val);
+      break;
+  }
+}
 
-  offset = range_contains(range(RAM), addr);
+// The scratchpad is the first 1KB of its page. The rest goes down the
+// MMIO path and faults like any other unmapped address.
+static inline bool past_scratchpad(Addr addr) {
+  return (addr.data >> MEM_PAGE_SHIFT) == (range(SCRATCH_PAD).start >> MEM_PAGE_SHIFT) &&
+    (addr.data & (MEM_PAGE_SIZE - 1)) >= range(SCRATCH_PAD).size;
+}
+
+// RAM, BIOS and the scratchpad are served from the page tables
+static uint32_t load_mmio(Interconnect *inter, SharedState *shared, Addr addr, AddrType type) {
+  int32_t offset = range_contains(range(CACHE_CONTROL), addr);
   if (offset >= 0)
-    return load_ram(&inter->ram, MAKE_Addr(offset), type);
+    return inter->icache.control;
 
   offset = range_contains(range(IRQ), addr);
   if (offset >= 0) {
@@ -69,11 +118,6 @@ uint32_t load(Interconnect *inter, SharedState *shared, Addr addr, AddrType type
     return 0;
   }
 
-  offset = range_contains(range(SCRATCH_PAD), addr);
-  if (offset >= 0) {
-    return load_scratchpad(&inter->pad, MAKE_Addr(offset), type);
-  }
-
   offset = range_contains(range(EXPANSION1), addr);
   if (offset >= 0)
     return 0xFF;
@@ -81,9 +125,17 @@ uint32_t load(Interconnect *inter, SharedState *shared, Addr addr, AddrType type
   fatal("Unhandled load call. Address: 0x%08X, Type: %d", addr, type);
 }
 
-void store(Interconnect *inter, SharedState *shared, Addr addr, uint32_t val, AddrType type) {
+uint32_t load(Interconnect *inter, SharedState *shared, Addr addr, AddrType type) {
   addr = mask_region(addr);
 
+  uint32_t page = addr.data >> MEM_PAGE_SHIFT;
+  if (page < MEM_PAGE_COUNT && inter->read_pages[page] && !past_scratchpad(addr))
+    return load_host(inter->read_pages[page] + (addr.data & (MEM_PAGE_SIZE - 1)), type);
+
+  return load_mmio(inter, shared, addr, type);
+}
+
+static void store_mmio(Interconnect *inter, SharedState *shared, Addr addr, uint32_t val, AddrType type) {
   int32_t offset = range_contains(range(MEM_CONTROL), addr);
   if (offset >= 0) {
     switch (offset) {
@@ -102,12 +154,6 @@ void store(Interconnect *inter, SharedState *shared, Addr addr, uint32_t val, Ad
     return;
   }
 
-  offset = range_contains(range(RAM), addr);
-  if (offset >= 0) {
-    store_ram(&inter->ram, MAKE_Addr(offset), val, type);
-    return;
-  }
-
   offset = range_contains(range(RAM_SIZE), addr);
   if (offset >= 0) {
     log_error("Unhandled Write to RAM_SIZE register. addr: 0x%08X. val: 0x%08X, type: %d", addr, val, type);
@@ -116,7 +162,7 @@ void store(Interconnect *inter, SharedState *shared, Addr addr, uint32_t val, Ad
 
   offset = range_contains(range(CACHE_CONTROL), addr);
   if (offset >= 0) {
-    log_error("Unhandled Write to CACHE_CONTROL register. addr: 0x%08X. val: 0x%08X, type: %d", addr, val, type);
+    inter->icache.control = val;
     return;
   }
 
@@ -145,12 +191,6 @@ void store(Interconnect *inter, SharedState *shared, Addr addr, uint32_t val, Ad
     return;
   }
 
-  offset = range_contains(range(SCRATCH_PAD), addr);
-  if (offset >= 0) {
-    store_scratchpad(&inter->pad, MAKE_Addr(offset), val, type);
-    return;
-  }
-
   offset = range_contains(range(TIMERS), addr);
   if (offset >= 0) {
     store_timers(&inter->timers, shared, &inter->gpu, MAKE_Addr(offset), val, type);
@@ -178,6 +218,32 @@ void store(Interconnect *inter, SharedState *shared, Addr addr, uint32_t val, Ad
   fatal("Unhandled store call. addr: 0x%08X, val: 0x%08X, type: %d", addr, val, type);
 }
 
+void store(Interconnect *inter, SharedState *shared, Addr addr, uint32_t val, AddrType type) {
+  addr = mask_region(addr);
+
+  uint32_t page = addr.data >> MEM_PAGE_SHIFT;
+  if (page < MEM_PAGE_COUNT && inter->write_pages[page] && !past_scratchpad(addr)) {
+    store_host(inter->write_pages[page] + (addr.data & (MEM_PAGE_SIZE - 1)), val, type);
+    // Only RAM and the scratchpad are writable through the page table
+    if (addr.data < range(RAM).size) {
+      code_cache_invalidate(&inter->code_cache, addr);
+      mark_dirty(&inter->ram.dirty, addr.data & (RAM_PHYSICAL_SIZE - 1));
+    } else
+      mark_dirty(&inter->pad.dirty, addr.data & (MEM_PAGE_SIZE - 1));
+    return;
+  }
+
+  store_mmio(inter, shared, addr, val, type);
+}
+
+// Host memory backing code page `index`, see code_page_index
+uint8_t const *code_page_host_ptr(Interconnect *inter, int32_t index) {
+  if (index < CODE_RAM_PAGE_COUNT)
+    return inter->ram.data + (index << CODE_PAGE_SHIFT);
+
+  return inter->bios.data + ((index - CODE_RAM_PAGE_COUNT) << CODE_PAGE_SHIFT);
+}
+
 uint32_t get_dma_reg(Interconnect *inter, Addr offset) {
   uint8_t major = (offset.data & 0x70) >> 4;
   uint8_t minor = offset.data & 0xF;
@@ -277,7 +343,7 @@ void set_dma_reg(Interconnect *inter, Addr offset, uint32_t val) {
 }
 
 void perform_dma_block(Interconnect *inter, DmaPort port) {
-  START_LOGGING_PC();
+  START_LOGGING_PC(inter->ctx);
 
   DmaChannel *channel = inter->dma.channels + port;
   int8_t increment = 4 - 8 * channel->step;
@@ -287,8 +353,8 @@ void perform_dma_block(Interconnect *inter, DmaPort port) {
   if (transfer_size == 0)
     fatal("perform_dma_block called in LinkedList Mode!");
   
-  LOG_OUTPUT(inter->output_log_index, "DMA BLOCK COPY. Port: %x, Control: %08x, Dest: RAM, Addr: %08x, Size: %08x", port, get_dma_channel_control(channel), addr.data, transfer_size);
-  print_output_log(inter->output_log_index);
+  LOG_OUTPUT(inter->ctx, inter->output_log_index, "DMA BLOCK COPY. Port: %x, Control: %08x, Dest: RAM, Addr: %08x, Size: %08x", port, get_dma_channel_control(channel), addr.data, transfer_size);
+  print_output_log(inter->ctx, inter->output_log_index);
 
   while (transfer_size > 0) {
     Addr cur_addr = MAKE_Addr(addr.data & 0x001FFFFC);
@@ -296,7 +362,7 @@ void perform_dma_block(Interconnect *inter, DmaPort port) {
     switch (channel->direction) {
       case DmaFromRam:
         {
-          uint32_t source_word = load_ram(&inter->ram, cur_addr, AddrWord);
+          uint32_t source_word = read_le32(inter->ram.data + cur_addr.data);
           switch (port) {
             case DmaGpu:
               gpu_gp0(&inter->gpu, source_word);
@@ -320,9 +386,11 @@ void perform_dma_block(Interconnect *inter, DmaPort port) {
               fatal("Unhandled DMA Port. port: 0x%08X", port);
           }
 
-          LOG_OUTPUT(inter->output_log_index, "DMA BLOCK COPY: Addr: %08x, Data: %08x", cur_addr.data, source_word);
-          print_output_log(inter->output_log_index);
-          store_ram(&inter->ram, cur_addr, source_word, AddrWord);
+          LOG_OUTPUT(inter->ctx, inter->output_log_index, "DMA BLOCK COPY: Addr: %08x, Data: %08x", cur_addr.data, source_word);
+          print_output_log(inter->ctx, inter->output_log_index);
+          write_le32(inter->ram.data + cur_addr.data, source_word);
+          code_cache_invalidate(&inter->code_cache, cur_addr);
+          mark_dirty(&inter->ram.dirty, cur_addr.data);
         }
     }
 
@@ -342,16 +410,16 @@ void perform_dma_linked_list(Interconnect *inter, DmaPort port) {
     fatal("Attempted LinkedList DMA on port: 0x%08X", port);
 
   while (1) {
-    uint32_t header = load_ram(&inter->ram, addr, AddrWord);
+    uint32_t header = read_le32(inter->ram.data + addr.data);
     uint32_t transfer_size = header >> 24;
 
-    LOG_OUTPUT(inter->output_log_index, "DMA Linked List. Port: %x, Control: %08x, Dest: GPU, Addr: %08x, Size: %08x, Header: %08X", port, get_dma_channel_control(channel), addr.data, transfer_size, header);
-    print_output_log(inter->output_log_index);
+    LOG_OUTPUT(inter->ctx, inter->output_log_index, "DMA Linked List. Port: %x, Control: %08x, Dest: GPU, Addr: %08x, Size: %08x, Header: %08X", port, get_dma_channel_control(channel), addr.data, transfer_size, header);
+    print_output_log(inter->ctx, inter->output_log_index);
 
     while (transfer_size > 0) {
       addr = MAKE_Addr((addr.data + 4) & 0x001FFFFC);
 
-      uint32_t command = load_ram(&inter->ram, addr, AddrWord);
+      uint32_t command = read_le32(inter->ram.data + addr.data);
 
       gpu_gp0(&inter->gpu, command);
 
@@ -381,9 +449,9 @@ void perform_dma(Interconnect *inter, DmaPort port) {
 }
 
 void interconnect_sync(Interconnect *inter, SharedState *shared) {
-  log_error("GPU Timings unimplemneted!");
-
+  // ToDo: Sync the GPU once its timings are implemented
   timers_sync(&inter->timers, shared);
+  update_sync_pending(&shared->clock);
 }
 
 void destroy_interconnect(Interconnect *inter) {
@@ -391,4 +459,7 @@ void destroy_interconnect(Interconnect *inter) {
   destroy_ram(&inter->ram);
   destroy_gpu(&inter->gpu);
   destroy_scratchpad(&inter->pad);
+  destroy_code_cache(&inter->code_cache);
+  free(inter->read_pages);
+  free(inter->write_pages);
 }
@@ -0,0 +1,535 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+
+#include "jit.h"
+#include "cpu.h"
+#include "log.h"
+
+#if defined(__x86_64__)
+
+#include <sys/mman.h>
+
+// mprotect granularity on x86-64
+#define HOST_PAGE_SIZE ((uintptr_t)4096)
+
+// The translated code keeps the Cpu pointer in rbx for the whole
+// block. Every instruction gets the same PC/delay slot bookkeeping
+// run_next_ins performs, then either a native translation (simple ALU
+// ops that can't fault) or a call into its op_* handler. After a call
+// the block bails out unless PC advanced sequentially, which covers
+// taken branches, exceptions and anything else that redirects
+// control. Stores also bail out if they invalidated the block's page.
+//
+// The code buffer is never writable and executable at once. The pages
+// a block is emitted into are writable while it is emitted and
+// executable afterwards.
+
+typedef enum X86Reg {
+  EAX = 0,
+  ECX = 1,
+  EDX = 2
+} X86Reg;
+
+typedef struct JitEmitter {
+  uint8_t *ptr;
+  uint8_t *exits[JIT_MAX_BLOCK_INS * 2];
+  size_t exit_count;
+} JitEmitter;
+
+#define CPU_OFFSET(field) ((int32_t)offsetof(Cpu, field))
+#define REG_OFFSET(index) (CPU_OFFSET(regs) + 4 * (int32_t)(index))
+#define LOAD_DELAY_INDEX_OFFSET (CPU_OFFSET(load_delay_slot) + (int32_t)offsetof(LoadDelaySlot, index))
+#define LOAD_DELAY_VAL_OFFSET (CPU_OFFSET(load_delay_slot) + (int32_t)offsetof(LoadDelaySlot, val))
+
+static void emit8(JitEmitter *e, uint8_t val) {
+  *e->ptr++ = val;
+}
+
+static void emit32(JitEmitter *e, uint32_t val) {
+  memcpy(e->ptr, &val, sizeof val);
+  e->ptr += sizeof val;
+}
+
+static void emit64(JitEmitter *e, uint64_t val) {
+  memcpy(e->ptr, &val, sizeof val);
+  e->ptr += sizeof val;
+}
+
+// mov r32, [rbx + disp32]
+static void emit_load(JitEmitter *e, X86Reg reg, int32_t disp) {
+  emit8(e, 0x8B);
+  emit8(e, 0x83 | (reg << 3));
+  emit32(e, disp);
+}
+
+// mov [rbx + disp32], r32
+static void emit_store(JitEmitter *e, X86Reg reg, int32_t disp) {
+  emit8(e, 0x89);
+  emit8(e, 0x83 | (reg << 3));
+  emit32(e, disp);
+}
+
+// mov dword [rbx + disp32], imm32
+static void emit_store_imm32(JitEmitter *e, int32_t disp, uint32_t imm) {
+  emit8(e, 0xC7);
+  emit8(e, 0x83);
+  emit32(e, disp);
+  emit32(e, imm);
+}
+
+// mov byte [rbx + disp32], imm8
+static void emit_store_imm8(JitEmitter *e, int32_t disp, uint8_t imm) {
+  emit8(e, 0xC6);
+  emit8(e, 0x83);
+  emit32(e, disp);
+  emit8(e, imm);
+}
+
+// jne to the block epilogue, patched once the block is complete
+static void emit_jne_exit(JitEmitter *e) {
+  emit8(e, 0x0F);
+  emit8(e, 0x85);
+  e->exits[e->exit_count++] = e->ptr;
+  emit32(e, 0);
+}
+
+static void emit_prologue(JitEmitter *e) {
+  // push rbx; mov rbx, rdi
+  emit8(e, 0x53);
+  emit8(e, 0x48);
+  emit8(e, 0x89);
+  emit8(e, 0xFB);
+}
+
+static void emit_epilogue(JitEmitter *e) {
+  uint8_t *epilogue = e->ptr;
+
+  // pop rbx; ret
+  emit8(e, 0x5B);
+  emit8(e, 0xC3);
+
+  for (size_t index = 0; index < e->exit_count; index++) {
+    int32_t rel = epilogue - (e->exits[index] + 4);
+    memcpy(e->exits[index], &rel, sizeof rel);
+  }
+}
+
+// Mirrors the bookkeeping done by run_next_ins before executing
+static void emit_ins_prologue(JitEmitter *e, Addr pc) {
+  // add qword [rbx + now], imm8
+  emit8(e, 0x48);
+  emit8(e, 0x83);
+  emit8(e, 0x83);
+  emit32(e, CPU_OFFSET(shared.clock.now));
+  emit8(e, CYCLES_PER_INS);
+  emit_store_imm32(e, CPU_OFFSET(current_pc), pc.data);
+  // pc = next_pc; next_pc += 4
+  emit_load(e, EAX, CPU_OFFSET(next_pc));
+  emit_store(e, EAX, CPU_OFFSET(pc));
+  emit8(e, 0x05);
+  emit32(e, 4);
+  emit_store(e, EAX, CPU_OFFSET(next_pc));
+  // delay_slot = branch; branch = false
+  emit8(e, 0x0F);
+  emit8(e, 0xB6);
+  emit8(e, 0x83);
+  emit32(e, CPU_OFFSET(branch));
+  emit8(e, 0x88);
+  emit8(e, 0x83);
+  emit32(e, CPU_OFFSET(delay_slot));
+  emit_store_imm8(e, CPU_OFFSET(branch), 0);
+}
+
+// Same as delayed_load()
+static void emit_delayed_load(JitEmitter *e) {
+  // movzx ecx, byte [rbx + index]
+  emit8(e, 0x0F);
+  emit8(e, 0xB6);
+  emit8(e, 0x8B);
+  emit32(e, LOAD_DELAY_INDEX_OFFSET);
+  emit_load(e, EDX, LOAD_DELAY_VAL_OFFSET);
+  // mov [rbx + rcx * 4 + regs], edx
+  emit8(e, 0x89);
+  emit8(e, 0x94);
+  emit8(e, 0x8B);
+  emit32(e, REG_OFFSET(0));
+  emit_store_imm8(e, LOAD_DELAY_INDEX_OFFSET, LOAD_DELAY_NONE);
+}
+
+static void emit_alu(JitEmitter *e, uint8_t opcode) {
+  // op eax, ecx
+  emit8(e, opcode);
+  emit8(e, 0xC8);
+}
+
+static void emit_shift_imm(JitEmitter *e, uint8_t ext, uint8_t shift) {
+  emit8(e, 0xC1);
+  emit8(e, 0xC0 | (ext << 3));
+  emit8(e, shift);
+}
+
+static void emit_shift_cl(JitEmitter *e, uint8_t ext) {
+  emit8(e, 0xD3);
+  emit8(e, 0xC0 | (ext << 3));
+}
+
+static void emit_setcc(JitEmitter *e, uint8_t cc) {
+  // setcc al; movzx eax, al
+  emit8(e, 0x0F);
+  emit8(e, cc);
+  emit8(e, 0xC0);
+  emit8(e, 0x0F);
+  emit8(e, 0xB6);
+  emit8(e, 0xC0);
+}
+
+static void emit_cmp_imm(JitEmitter *e, uint32_t imm) {
+  emit8(e, 0x3D);
+  emit32(e, imm);
+}
+
+static void emit_op_imm(JitEmitter *e, uint8_t opcode, uint32_t imm) {
+  // op eax, imm32
+  emit8(e, opcode);
+  emit32(e, imm);
+}
+
+// Emits a native version of `ins` leaving the result in eax. Returns
+// the destination register, or -1 if the instruction needs its handler.
+static int32_t emit_native_alu(JitEmitter *e, DecodedIns const *ins) {
+  uint32_t func = get_func(ins->ins);
+
+  if (func == 0x0) {
+    uint32_t sub_func = get_sub_func(ins->ins);
+
+    switch (sub_func) {
+      case 0x0:
+      case 0x2:
+      case 0x3:
+        emit_load(e, EAX, REG_OFFSET(ins->rt.data));
+        emit_shift_imm(e, (sub_func == 0x0) ? 4 : (sub_func == 0x2) ? 5 : 7, ins->imm);
+        break;
+      case 0x4:
+      case 0x6:
+      case 0x7:
+        emit_load(e, EAX, REG_OFFSET(ins->rt.data));
+        emit_load(e, ECX, REG_OFFSET(ins->rs.data));
+        emit_shift_cl(e, (sub_func == 0x4) ? 4 : (sub_func == 0x6) ? 5 : 7);
+        break;
+      case 0x10:
+        emit_load(e, EAX, CPU_OFFSET(hi));
+        break;
+      case 0x12:
+        emit_load(e, EAX, CPU_OFFSET(lo));
+        break;
+      case 0x21:
+      case 0x23:
+      case 0x24:
+      case 0x25:
+      case 0x26:
+      case 0x27:
+      case 0x2A:
+      case 0x2B:
+        emit_load(e, EAX, REG_OFFSET(ins->rs.data));
+        emit_load(e, ECX, REG_OFFSET(ins->rt.data));
+        switch (sub_func) {
+          case 0x21:
+            emit_alu(e, 0x01);
+            break;
+          case 0x23:
+            emit_alu(e, 0x29);
+            break;
+          case 0x24:
+            emit_alu(e, 0x21);
+            break;
+          case 0x25:
+            emit_alu(e, 0x09);
+            break;
+          case 0x26:
+            emit_alu(e, 0x31);
+            break;
+          case 0x27:
+            // or eax, ecx; not eax
+            emit_alu(e, 0x09);
+            emit8(e, 0xF7);
+            emit8(e, 0xD0);
+            break;
+          case 0x2A:
+            emit_alu(e, 0x39);
+            emit_setcc(e, 0x9C);
+            break;
+          case 0x2B:
+            emit_alu(e, 0x39);
+            emit_setcc(e, 0x92);
+            break;
+        }
+        break;
+      default:
+        return -1;
+    }
+
+    return ins->rd.data;
+  }
+
+  switch (func) {
+    case 0x9:
+      emit_load(e, EAX, REG_OFFSET(ins->rs.data));
+      emit_op_imm(e, 0x05, ins->imm);
+      break;
+    case 0xA:
+      emit_load(e, EAX, REG_OFFSET(ins->rs.data));
+      emit_cmp_imm(e, ins->imm);
+      emit_setcc(e, 0x9C);
+      break;
+    case 0xB:
+      emit_load(e, EAX, REG_OFFSET(ins->rs.data));
+      emit_cmp_imm(e, ins->imm);
+      emit_setcc(e, 0x92);
+      break;
+    case 0xC:
+      emit_load(e, EAX, REG_OFFSET(ins->rs.data));
+      emit_op_imm(e, 0x25, ins->imm);
+      break;
+    case 0xD:
+      emit_load(e, EAX, REG_OFFSET(ins->rs.data));
+      emit_op_imm(e, 0x0D, ins->imm);
+      break;
+    case 0xE:
+      emit_load(e, EAX, REG_OFFSET(ins->rs.data));
+      emit_op_imm(e, 0x35, ins->imm);
+      break;
+    case 0xF:
+      // mov eax, imm32
+      emit8(e, 0xB8);
+      emit32(e, ins->imm << 16);
+      break;
+    default:
+      return -1;
+  }
+
+  return ins->rt.data;
+}
+
+static void emit_handler_call(JitEmitter *e, DecodedIns const *ins) {
+  // mov rdi, rbx; mov rsi, ins; mov rax, handler; call rax
+  emit8(e, 0x48);
+  emit8(e, 0x89);
+  emit8(e, 0xDF);
+  emit8(e, 0x48);
+  emit8(e, 0xBE);
+  emit64(e, (uintptr_t)ins);
+  emit8(e, 0x48);
+  emit8(e, 0xB8);
+  emit64(e, (uintptr_t)ins->handler);
+  emit8(e, 0xFF);
+  emit8(e, 0xD0);
+}
+
+static void emit_pc_check(JitEmitter *e, Addr expected) {
+  // cmp dword [rbx + pc], imm32
+  emit8(e, 0x81);
+  emit8(e, 0xBB);
+  emit32(e, CPU_OFFSET(pc));
+  emit32(e, expected.data);
+  emit_jne_exit(e);
+}
+
+static void emit_generation_check(JitEmitter *e, CodePage const *page) {
+  // mov rax, &page->generation; cmp dword [rax], imm32
+  emit8(e, 0x48);
+  emit8(e, 0xB8);
+  emit64(e, (uintptr_t)&page->generation);
+  emit8(e, 0x81);
+  emit8(e, 0x38);
+  emit32(e, page->generation);
+  emit_jne_exit(e);
+}
+
+static bool is_store(DecodedIns const *ins) {
+  uint32_t func = get_func(ins->ins);
+
+  return func >= 0x28 && func <= 0x2E;
+}
+
+// Jumps and branches, taken or not, end the block after their delay slot
+static bool is_branch(DecodedIns const *ins) {
+  uint32_t func = get_func(ins->ins);
+
+  if (func >= 0x1 && func <= 0x7)
+    return true;
+
+  if (func == 0x0) {
+    uint32_t sub_func = get_sub_func(ins->ins);
+    return sub_func == 0x8 || sub_func == 0x9;
+  }
+
+  return false;
+}
+
+static bool always_traps(DecodedIns const *ins) {
+  if (get_func(ins->ins) != 0x0)
+    return false;
+
+  uint32_t sub_func = get_sub_func(ins->ins);
+
+  return sub_func == 0xC || sub_func == 0xD;
+}
+
+static void protect_code(uint8_t *start, uint8_t *end, int prot) {
+  uintptr_t first = (uintptr_t)start & ~(HOST_PAGE_SIZE - 1);
+  uintptr_t last = ((uintptr_t)end + HOST_PAGE_SIZE - 1) & ~(HOST_PAGE_SIZE - 1);
+
+  if (mprotect((void *)first, last - first, prot) != 0)
+    fatal("JitError: Couldn't change code buffer protection");
+}
+
+static void flush_jit(Jit *jit) {
+  for (size_t index = 0; index < CODE_PAGE_COUNT; index++) {
+    if (jit->pages[index])
+      memset(jit->pages[index], 0, sizeof(JitPage));
+  }
+
+  jit->used = 0;
+  protect_code(jit->buffer, jit->buffer + JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE);
+}
+
+static void compile_block(Cpu *cpu, JitBlock *block, CodePage *page) {
+  Jit *jit = &cpu->jit;
+
+  if (jit->buffer == NULL) {
+    jit->buffer = mmap(NULL, JIT_BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (jit->buffer == MAP_FAILED)
+      fatal("JitError: Couldn't map code buffer");
+    jit->used = 0;
+  }
+
+  if (jit->used + JIT_MAX_BLOCK_BYTES > JIT_BUFFER_SIZE)
+    flush_jit(jit);
+
+  JitEmitter emitter = {0};
+  JitEmitter *e = &emitter;
+  uint8_t *start = jit->buffer + jit->used;
+  e->ptr = start;
+  // Blocks share pages, so the one before this may have been made executable
+  protect_code(start, start + JIT_MAX_BLOCK_BYTES, PROT_READ | PROT_WRITE);
+
+  emit_prologue(e);
+
+  Addr pc = cpu->pc;
+  bool end_after_next = false;
+
+  for (size_t count = 0; count < JIT_MAX_BLOCK_INS; count++) {
+    if (count > 0 && has_pc_hook(pc))
+      break;
+
+    DecodedIns uncached;
+    DecodedIns const *ins = fetch_decoded_ins(cpu, pc, &uncached);
+    Addr next = MAKE_Addr(pc.data + 4);
+    bool last = end_after_next || always_traps(ins) || (next.data % CODE_PAGE_SIZE) == 0 || count == JIT_MAX_BLOCK_INS - 1;
+
+    emit_ins_prologue(e, pc);
+
+    int32_t dest = emit_native_alu(e, ins);
+    if (dest >= 0) {
+      emit_delayed_load(e);
+      if (dest != 0)
+        emit_store(e, EAX, REG_OFFSET(dest));
+    } else {
+      emit_handler_call(e, ins);
+      if (is_store(ins))
+        emit_generation_check(e, page);
+      if (!last)
+        emit_pc_check(e, next);
+    }
+
+    if (last)
+      break;
+
+    end_after_next = is_branch(ins);
+    pc = next;
+  }
+
+  emit_epilogue(e);
+  protect_code(start, e->ptr, PROT_READ | PROT_EXEC);
+
+  jit->used += e->ptr - start;
+  // Keep blocks 16-byte aligned
+  jit->used = (jit->used + 15) & ~(size_t)15;
+
+  // ISO C has no object to function pointer cast, so copy the bits
+  memcpy(&block->code, &start, sizeof block->code);
+  block->start_pc = cpu->pc;
+  block->generation = page->generation;
+}
+
+Jit init_jit() {
+  Jit jit;
+
+  jit.buffer = NULL;
+  jit.used = 0;
+  for (size_t index = 0; index < CODE_PAGE_COUNT; index++)
+    jit.pages[index] = NULL;
+
+  return jit;
+}
+
+bool jit_supported() {
+  return true;
+}
+
+void run_next_block(Cpu *cpu) {
+  int32_t index = code_page_index(cpu->pc);
+
+  if (index < 0 || cpu->pc.data % 4 || has_pc_hook(cpu->pc)) {
+    run_next_ins(cpu);
+    return;
+  }
+
+  Jit *jit = &cpu->jit;
+  if (jit->pages[index] == NULL) {
+    jit->pages[index] = calloc(1, sizeof(JitPage));
+    if (jit->pages[index] == NULL)
+      fatal("MemoryError: Couldn't allocate JIT page: %d", index);
+  }
+
+  JitBlock *block = &jit->pages[index]->blocks[(cpu->pc.data >> 2) & (CODE_PAGE_INS_COUNT - 1)];
+  CodePage *page = code_cache_page(&cpu->inter.code_cache, index);
+
+  if (block->code == NULL || block->start_pc.data != cpu->pc.data || block->generation != page->generation)
+    compile_block(cpu, block, page);
+
+  block->code(cpu);
+}
+
+void destroy_jit(Jit *jit) {
+  if (jit->buffer)
+    munmap(jit->buffer, JIT_BUFFER_SIZE);
+  jit->buffer = NULL;
+
+  for (size_t index = 0; index < CODE_PAGE_COUNT; index++) {
+    free(jit->pages[index]);
+    jit->pages[index] = NULL;
+  }
+}
+
+#else
+
+Jit init_jit() {
+  Jit jit = {0};
+
+  return jit;
+}
+
+bool jit_supported() {
+  return false;
+}
+
+void run_next_block(Cpu *cpu) {
+  run_next_ins(cpu);
+}
+
+void destroy_jit(Jit *jit) {
+}
+
+#endif
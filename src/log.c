@@ -22,21 +22,12 @@
 
 #include "log.h"
 
-#define MAX_CALLBACKS 32
+// Each thread logs through the Logger it bound with log_use, or through
+// the process-wide default if it never bound one.
+static Logger default_logger;
+static _Thread_local Logger *current_logger = NULL;
 
-typedef struct {
-  log_LogFn fn;
-  void *udata;
-  int level;
-} Callback;
-
-static struct {
-  void *udata;
-  log_LockFn lock;
-  int level;
-  bool quiet;
-  Callback callbacks[MAX_CALLBACKS];
-} L;
+#define L (*(current_logger ? current_logger : &default_logger))
 
 
 static const char *level_strings[] = {
@@ -96,6 +87,16 @@ const char* log_level_string(int level) {
 }
 
 
+Logger init_logger() {
+  return (Logger) { 0 };
+}
+
+
+void log_use(Logger *logger) {
+  current_logger = logger;
+}
+
+
 void log_set_lock(log_LockFn fn, void *udata) {
   L.lock = fn;
   L.udata = udata;
@@ -115,7 +116,7 @@ void log_set_quiet(bool enable) {
 int log_add_callback(log_LogFn fn, void *udata, int level) {
   for (int i = 0; i < MAX_CALLBACKS; i++) {
     if (!L.callbacks[i].fn) {
-      L.callbacks[i] = (Callback) { fn, udata, level };
+      L.callbacks[i] = (log_Callback) { fn, udata, level };
       return 0;
     }
   }
@@ -129,9 +130,10 @@ int log_add_fp(FILE *fp, int level) {
 
 
 static void init_event(log_Event *ev, void *udata) {
+  static _Thread_local struct tm tm;
   if (!ev->time) {
     time_t t = time(NULL);
-    ev->time = localtime(&t);
+    ev->time = localtime_r(&t, &tm);
   }
   ev->udata = udata;
 }
@@ -155,7 +157,7 @@ void log_log(int level, const char *file, int line, const char *fmt, ...) {
   }
 
   for (int i = 0; i < MAX_CALLBACKS && L.callbacks[i].fn; i++) {
-    Callback *cb = &L.callbacks[i];
+    log_Callback *cb = &L.callbacks[i];
     if (level >= cb->level) {
       init_event(&ev, cb->udata);
       va_start(ev.ap, fmt);
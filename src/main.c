@@ -1,50 +1,130 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <SDL2/SDL.h>
 
+#include "context.h"
 #include "cpu.h"
+#include "fastboot.h"
+#include "savestate.h"
+#include "rewind.h"
 #include "flag.h"
 #include "log.h"
 
-FlagSet flag_set = 0x0;
+// Where --fast-boot keeps its boot states
+static char const *boot_cache_dir = ".";
+static char const *state_filename = NULL;
+// Seconds of history kept for rewinding, 0 to disable
+static uint32_t rewind_seconds = 0;
+// Threads drawing GPU tiles besides the render thread
+static uint32_t gpu_workers = 0;
+
+// CPU cycles in one NTSC frame
+#define FRAME_CYCLES 564480
 
 bool prefix(char const *str, char const *pre) {
   return strncmp(pre, str, strlen(pre)) == 0;
 }
 
-void set_env(int argc, char **argv) {
-  set_rom_filename("");
+void set_env(Context *ctx, int argc, char **argv) {
   for(size_t i=1; i<argc; i++) {
     if (strcmp(argv[i], "--print-pc") == 0)
-      set_flag(PRINT_PC);
+      set_flag(ctx, PRINT_PC);
     else if (strcmp(argv[i], "--print-ins") == 0)
-      set_flag(PRINT_INS);
+      set_flag(ctx, PRINT_INS);
     else if (strcmp(argv[i], "--quiet") == 0)
       log_set_quiet(1);
     else if (strcmp(argv[i], "--output-log") == 0) {
       log_set_quiet(1);
-      set_flag(OUTPUT_LOG);
+      set_flag(ctx, OUTPUT_LOG);
     } else if (prefix(argv[i], "--rom=")) {
-      set_rom_filename(argv[i] + 6);
+      set_rom_filename(ctx, argv[i] + 6);
+    } else if (strcmp(argv[i], "--cpu=jit") == 0)
+      set_flag(ctx, CPU_JIT);
+    else if (strcmp(argv[i], "--cpu=interpreter") == 0)
+      clear_flag(ctx, CPU_JIT);
+    else if (strcmp(argv[i], "--headless") == 0)
+      set_flag(ctx, HEADLESS);
+    else if (strcmp(argv[i], "--no-hle") == 0)
+      set_flag(ctx, NO_HLE);
+    else if (strcmp(argv[i], "--gpu-thread") == 0)
+      set_flag(ctx, GPU_THREAD);
+    else if (prefix(argv[i], "--gpu-workers=")) {
+      set_flag(ctx, GPU_THREAD);
+      gpu_workers = strtoul(argv[i] + 14, NULL, 10);
+    }
+    else if (strcmp(argv[i], "--fast-boot") == 0)
+      set_flag(ctx, FAST_BOOT);
+    else if (prefix(argv[i], "--rewind="))
+      rewind_seconds = strtoul(argv[i] + 9, NULL, 10);
+    else if (prefix(argv[i], "--load-state="))
+      state_filename = argv[i] + 13;
+    else if (prefix(argv[i], "--boot-cache=")) {
+      set_flag(ctx, FAST_BOOT);
+      boot_cache_dir = argv[i] + 13;
     }
+    else if (prefix(argv[i], "--cpu="))
+      fatal("ArgError: Unknown CPU backend: %s", argv[i] + 6);
+  }
+
+  // Translated blocks skip the per-instruction tracing hooks
+  if (get_flag(ctx, CPU_JIT) && tracing_enabled(ctx)) {
+    log_warn("Tracing needs the interpreter, ignoring --cpu=jit");
+    clear_flag(ctx, CPU_JIT);
+  }
+
+  if (get_flag(ctx, CPU_JIT) && !jit_supported()) {
+    log_warn("JIT isn't supported on this host, using the interpreter");
+    clear_flag(ctx, CPU_JIT);
   }
 }
 
 int main(int argc, char **argv) {
-  set_env(argc, argv);
+  Context ctx = init_context();
+  log_use(&ctx.logger);
+  set_env(&ctx, argc, argv);
 
-  if (SDL_Init(SDL_INIT_VIDEO) < 0)
+  if (!get_flag(&ctx, HEADLESS) && SDL_Init(SDL_INIT_VIDEO) < 0)
     fatal("SDLError: Couldn't init SDL. %s", SDL_GetError());
 
-  Cpu cpu = init_cpu("SCPH1001.BIN");
+  Cpu cpu = init_cpu(&ctx, "SCPH1001.BIN");
+  if (get_flag(&ctx, NO_HLE))
+    hle_disable_all(&cpu.hle);
+  if (state_filename) {
+    if (!load_state(&cpu, state_filename))
+      fatal("StateError: Couldn't load state: %s", state_filename);
+  } else if (get_flag(&ctx, FAST_BOOT))
+    fast_boot(&cpu, boot_cache_dir);
+  // `cpu` stays put from here on
+  if (get_flag(&ctx, GPU_THREAD))
+    gpu_start_thread(&cpu.inter.gpu, gpu_workers);
 
+  Rewind rewind;
+  if (rewind_seconds)
+    init_rewind(&rewind, &cpu, rewind_seconds * REWIND_FPS, REWIND_DEFAULT_MEMORY_CAP);
+
+  // cpu_run also returns at peripheral syncs, so frames are counted in
+  // cycles. The overshoot carries over into the next frame.
+  uint64_t frame_cycles = 0;
   while (1) {
-    run_next_ins(&cpu);
+    frame_cycles += cpu_run(&cpu, MAKE_Cycles(FRAME_CYCLES - frame_cycles)).data;
+    if (frame_cycles < FRAME_CYCLES)
+      continue;
+    frame_cycles -= FRAME_CYCLES;
+
+    if (get_flag(&ctx, GPU_THREAD))
+      gpu_present(&cpu.inter.gpu);
+    if (rewind_seconds)
+      rewind_capture(&rewind, &cpu);
   }
 
+  if (rewind_seconds)
+    destroy_rewind(&rewind);
   destroy_cpu(&cpu);
+  destroy_context(&ctx);
 
-  SDL_Quit();
+  if (!get_flag(&ctx, HEADLESS))
+    SDL_Quit();
 
   return 0;
 }
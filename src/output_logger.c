@@ -3,29 +3,25 @@
 
 #include "output_logger.h"
 
-OutputLogBuffer *buffers = NULL;
-
-size_t const init_output_log() {
-  if (!get_flag(OUTPUT_LOG))
+size_t const init_output_log(Context *ctx) {
+  if (!get_flag(ctx, OUTPUT_LOG))
     return 0;
-  if (next_pool_index >= OUTPUT_LOG_POOL_SIZE)
+  if (ctx->next_pool_index >= OUTPUT_LOG_POOL_SIZE)
     return 0;
 
-  if (buffers == NULL)
-    buffers = calloc(OUTPUT_LOG_POOL_SIZE, sizeof(OutputLogBuffer));
-
-  memset(buffers[next_pool_index].buffer, 0, OUTPUT_LOG_LINE_LEN);
-  buffers[next_pool_index].pos = 0;
-  next_pool_index++;
+  OutputLogBuffer *buffer = &ctx->buffers[ctx->next_pool_index];
+  memset(buffer->buffer, 0, OUTPUT_LOG_LINE_LEN);
+  buffer->pos = 0;
+  ctx->next_pool_index++;
 
-  return next_pool_index - 1;
+  return ctx->next_pool_index - 1;
 }
 
-void print_output_log(size_t index) {
-  if (!get_flag(OUTPUT_LOG))
+void print_output_log(Context *ctx, size_t index) {
+  if (!get_flag(ctx, OUTPUT_LOG))
     return;
 
-  printf("%s\n", buffers[index].buffer);
-  memset(buffers[index].buffer, 0, OUTPUT_LOG_LINE_LEN);
-  buffers[index].pos = 0;
+  printf("%s\n", ctx->buffers[index].buffer);
+  memset(ctx->buffers[index].buffer, 0, OUTPUT_LOG_LINE_LEN);
+  ctx->buffers[index].pos = 0;
 }
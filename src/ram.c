@@ -1,34 +1,82 @@
+#define _GNU_SOURCE
 #include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "ram.h"
 #include "flag.h"
+#include "byteorder.h"
+
+// Maps a memfd holding the physical RAM once per mirror into a single
+// reserved range. Returns NULL if the host can't do it.
+static uint8_t *map_mirrored_ram() {
+#if defined(__linux__)
+  int fd = memfd_create("psx-ram", 0);
+  if (fd < 0)
+    return NULL;
+
+  if (ftruncate(fd, RAM_PHYSICAL_SIZE) < 0) {
+    close(fd);
+    return NULL;
+  }
+
+  uint8_t *base = mmap(NULL, range(RAM).size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (base == MAP_FAILED) {
+    close(fd);
+    return NULL;
+  }
+
+  for (uint32_t offset = 0; offset < range(RAM).size; offset += RAM_PHYSICAL_SIZE) {
+    if (mmap(base + offset, RAM_PHYSICAL_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0) == MAP_FAILED) {
+      munmap(base, range(RAM).size);
+      close(fd);
+      return NULL;
+    }
+  }
+
+  // The mappings keep the memory alive
+  close(fd);
+
+  return base;
+#else
+  return NULL;
+#endif
+}
 
 Ram init_ram() {
   Ram ram;
-  ram.data = calloc(range(RAM).size, sizeof(uint8_t));
+  ram.data = map_mirrored_ram();
+  ram.mirrored = ram.data != NULL;
+
+  if (!ram.mirrored) {
+    ram.data = calloc(RAM_PHYSICAL_SIZE, sizeof(uint8_t));
+    if (ram.data == NULL)
+      fatal("MemoryError: Couldn't allocate RAM");
+  }
 
-  for(int index = 0; index < range(RAM).size; index++)
-    ram.data[index] = 0xca;
+  memset(ram.data, 0xca, RAM_PHYSICAL_SIZE);
+  ram.dirty = init_dirty_map(RAM_PHYSICAL_SIZE);
 
   return ram;
 }
 
-uint32_t load_ram32(Ram *ram, Addr offset) {
+uint8_t *ram_host_ptr(Ram *ram, uint32_t offset) {
+  if (ram->mirrored)
+    return ram->data + offset;
 
-  uint32_t b0 = ram->data[offset.data++]; 
-  uint32_t b1 = ram->data[offset.data++]; 
-  uint32_t b2 = ram->data[offset.data++]; 
-  uint32_t b3 = ram->data[offset.data++]; 
+  return ram->data + (offset & (RAM_PHYSICAL_SIZE - 1));
+}
 
-  return b0 | (b1 << 8) | (b2 << 16) | (b3 << 24);
+uint32_t load_ram32(Ram *ram, Addr offset) {
+  return read_le32(ram->data + offset.data);
 }
 
 uint16_t load_ram16(Ram *ram, Addr offset) {
-
-  uint16_t b0 = ram->data[offset.data++];
-  uint16_t b1 = ram->data[offset.data++];
-
-  return b0 | (b1 << 8);
+  return read_le16(ram->data + offset.data);
 }
 
 uint8_t load_ram8(Ram *ram, Addr offset) {
@@ -47,25 +95,11 @@ uint32_t load_ram(Ram *ram, Addr offset, AddrType type) {
 }
 
 void store_ram32(Ram *ram, Addr offset, uint32_t val) {
-
-  uint8_t b0 = val;
-  uint8_t b1 = val >> 8;
-  uint8_t b2 = val >> 16;
-  uint8_t b3 = val >> 24;
-
-  ram->data[offset.data++] = b0; 
-  ram->data[offset.data++] = b1; 
-  ram->data[offset.data++] = b2; 
-  ram->data[offset.data++] = b3; 
+  write_le32(ram->data + offset.data, val);
 }
 
 void store_ram16(Ram *ram, Addr offset, uint16_t val) {
-
-  uint8_t b0 = val;
-  uint8_t b1 = val >> 8;
-
-  ram->data[offset.data++] = b0;
-  ram->data[offset.data++] = b1;
+  write_le16(ram->data + offset.data, val);
 }
 
 void store_ram8(Ram *ram, Addr offset, uint8_t val) {
@@ -73,6 +107,8 @@ void store_ram8(Ram *ram, Addr offset, uint8_t val) {
 }
 
 void store_ram(Ram *ram, Addr offset, uint32_t val, AddrType type) {
+  mark_dirty(&ram->dirty, offset.data & (RAM_PHYSICAL_SIZE - 1));
+
   switch (type) {
     case AddrByte:
       store_ram8(ram, offset, val);
@@ -87,5 +123,11 @@ void store_ram(Ram *ram, Addr offset, uint32_t val, AddrType type) {
 }
 
 void destroy_ram(Ram *ram) {
+#if defined(__linux__)
+  if (ram->mirrored) {
+    munmap(ram->data, range(RAM).size);
+    return;
+  }
+#endif
   free(ram->data);
 }
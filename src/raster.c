@@ -0,0 +1,87 @@
+#include <string.h>
+
+#include "raster.h"
+
+// One pixel at a time. Also draws the tails of the vector kernels.
+void scalar_tri_span(Gpu *gpu, TriSpan const *span) {
+  uint32_t value[SpanValueCount];
+  memcpy(value, span->value, sizeof value);
+
+  uint16_t *target = span->target;
+  for (int32_t i = 0; i < span->count; i++, target++) {
+    if (span_covered(value)) {
+      Vec3 shaded_color = {attr_value(value[SpanR]), attr_value(value[SpanG]), attr_value(value[SpanB])};
+      uint16_t u = attr_value(value[SpanU]);
+      uint16_t v = attr_value(value[SpanV]);
+      uint16_t new_color;
+      switch (gpu->blend_mode) {
+        case GpuNoTexture:
+          *target = vec_to_555(shaded_color);
+          break;
+        case GpuBlendedTexture:
+          new_color = multiply_888_555(vec_to_888(shaded_color), get_texel(gpu, u, v, gpu->texture_depth));
+          if (new_color)
+            *target = new_color;
+          break;
+        case GpuRawTexture:
+          new_color = get_texel(gpu, u, v, gpu->texture_depth);
+          if (new_color)
+            *target = new_color;
+          break;
+      }
+    }
+
+    for (int k = 0; k < SpanValueCount; k++)
+      value[k] += span->dx[k];
+  }
+}
+
+void scalar_rect_span(Gpu *gpu, RectSpan const *span) {
+  uint16_t *target = span->target;
+
+  if (gpu->blend_mode == GpuNoTexture) {
+    for (int32_t i = 0; i < span->count; i++)
+      target[i] = span->color;
+    return;
+  }
+
+  for (int32_t i = 0; i < span->count; i++) {
+    uint16_t new_color = get_texel(gpu, span->u + i, span->v, gpu->texture_depth);
+    if (new_color)
+      target[i] = new_color;
+  }
+}
+
+static RasterKernels const scalar_kernels = {
+  "scalar",
+  scalar_tri_span,
+  scalar_rect_span
+};
+
+// NULL if `name` is unknown or the host can't run it
+RasterKernels const *find_raster_kernels(char const *name) {
+  if (strcmp(name, "scalar") == 0)
+    return &scalar_kernels;
+#if defined(__x86_64__)
+  // SSE2 is part of x86-64
+  if (strcmp(name, "sse2") == 0)
+    return &sse2_kernels;
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2"))
+    return &avx2_kernels;
+#endif
+
+  return NULL;
+}
+
+// The widest kernels the host supports
+RasterKernels const *select_raster_kernels() {
+  static char const *preferred[] = {"avx2", "sse2", "scalar"};
+
+  for (size_t i = 0; i < sizeof preferred / sizeof preferred[0]; i++) {
+    RasterKernels const *kernels = find_raster_kernels(preferred[i]);
+    if (kernels)
+      return kernels;
+  }
+
+  return &scalar_kernels;
+}
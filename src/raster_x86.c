@@ -0,0 +1,267 @@
+#if defined(__x86_64__)
+
+#include <immintrin.h>
+
+#include "raster.h"
+
+// Vector kernels draw whole blocks of 8 (SSE2) or 16 (AVX2) pixels and
+// hand the rest of the span to the scalar kernels, so they never touch
+// VRAM outside the span. Texels are still fetched one lane at a time,
+// all of a block before any of it is written.
+
+#define AVX2 __attribute__((target("avx2")))
+
+static inline __m128i sse2_attr(__m128i value) {
+  __m128i v = _mm_srai_epi32(value, 16);
+  return _mm_andnot_si128(_mm_srai_epi32(v, 31), v);
+}
+
+static inline __m128i sse2_color_555(__m128i r, __m128i g, __m128i b) {
+  __m128i mask = _mm_set1_epi32(0xF8);
+
+  return _mm_or_si128(
+    _mm_or_si128(
+      _mm_slli_epi32(_mm_and_si128(r, mask), 7),
+      _mm_slli_epi32(_mm_and_si128(g, mask), 2)),
+    _mm_srli_epi32(_mm_and_si128(b, mask), 3));
+}
+
+// multiply_888_555 per lane. The products fit in 16 bits, so the 16 bit
+// multiply and min work on the 32 bit lanes.
+static inline __m128i sse2_modulate(__m128i r, __m128i g, __m128i b, __m128i texel) {
+  __m128i byte = _mm_set1_epi32(0xFF);
+  __m128i channel = _mm_set1_epi32(0x1F);
+  __m128i limit = _mm_set1_epi32(31);
+
+  __m128i out_b = _mm_and_si128(texel, channel);
+  __m128i out_g = _mm_and_si128(_mm_srli_epi32(texel, 5), channel);
+  __m128i out_r = _mm_and_si128(_mm_srli_epi32(texel, 10), channel);
+  out_b = _mm_min_epi16(limit, _mm_srli_epi32(_mm_mullo_epi16(_mm_and_si128(b, byte), out_b), 7));
+  out_g = _mm_min_epi16(limit, _mm_srli_epi32(_mm_mullo_epi16(_mm_and_si128(g, byte), out_g), 7));
+  out_r = _mm_min_epi16(limit, _mm_srli_epi32(_mm_mullo_epi16(_mm_and_si128(r, byte), out_r), 7));
+
+  return _mm_or_si128(_mm_or_si128(_mm_slli_epi32(out_r, 10), _mm_slli_epi32(out_g, 5)), out_b);
+}
+
+// Packs two vectors of 32 bit pixels into 16 bit ones, keeping bit 15
+static inline __m128i sse2_pack_pixels(__m128i lo, __m128i hi) {
+  lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+  hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+  return _mm_packs_epi32(lo, hi);
+}
+
+static inline void sse2_store_masked(uint16_t *target, __m128i pixels, __m128i mask) {
+  __m128i old = _mm_loadu_si128((__m128i const *)target);
+  _mm_storeu_si128((__m128i *)target, _mm_or_si128(_mm_and_si128(mask, pixels), _mm_andnot_si128(mask, old)));
+}
+
+// Color and coverage of 4 pixels
+static inline void sse2_tri_pixels(Gpu *gpu, __m128i const value[SpanValueCount], __m128i *color, __m128i *covered) {
+  __m128i w = _mm_or_si128(_mm_or_si128(value[SpanW0], value[SpanW1]), value[SpanW2]);
+  *covered = _mm_cmpgt_epi32(w, _mm_set1_epi32(-1));
+
+  __m128i r = sse2_attr(value[SpanR]);
+  __m128i g = sse2_attr(value[SpanG]);
+  __m128i b = sse2_attr(value[SpanB]);
+
+  if (gpu->blend_mode == GpuNoTexture) {
+    *color = sse2_color_555(r, g, b);
+    return;
+  }
+
+  uint32_t u[4], v[4], mask[4], texel[4];
+  _mm_storeu_si128((__m128i *)u, sse2_attr(value[SpanU]));
+  _mm_storeu_si128((__m128i *)v, sse2_attr(value[SpanV]));
+  _mm_storeu_si128((__m128i *)mask, *covered);
+  for (int lane = 0; lane < 4; lane++)
+    texel[lane] = mask[lane] ? get_texel(gpu, u[lane], v[lane], gpu->texture_depth) : 0;
+
+  __m128i t = _mm_loadu_si128((__m128i const *)texel);
+  if (gpu->blend_mode == GpuBlendedTexture)
+    t = sse2_modulate(r, g, b, t);
+
+  *color = t;
+  // Black texels are transparent
+  *covered = _mm_andnot_si128(_mm_cmpeq_epi32(t, _mm_setzero_si128()), *covered);
+}
+
+static void sse2_tri_span(Gpu *gpu, TriSpan const *span) {
+  TriSpan rest = *span;
+  __m128i offset[SpanValueCount][2];
+
+  for (int k = 0; k < SpanValueCount; k++) {
+    uint32_t dx = span->dx[k];
+    offset[k][0] = _mm_setr_epi32(0, dx, 2 * dx, 3 * dx);
+    offset[k][1] = _mm_add_epi32(offset[k][0], _mm_set1_epi32(4 * dx));
+  }
+
+  while (rest.count >= 8) {
+    __m128i color[2], covered[2];
+
+    for (int half = 0; half < 2; half++) {
+      __m128i value[SpanValueCount];
+      for (int k = 0; k < SpanValueCount; k++)
+        value[k] = _mm_add_epi32(_mm_set1_epi32(rest.value[k]), offset[k][half]);
+      sse2_tri_pixels(gpu, value, &color[half], &covered[half]);
+    }
+
+    sse2_store_masked(rest.target, sse2_pack_pixels(color[0], color[1]), _mm_packs_epi32(covered[0], covered[1]));
+    advance_tri_span(&rest, 8);
+  }
+
+  scalar_tri_span(gpu, &rest);
+}
+
+static void sse2_rect_span(Gpu *gpu, RectSpan const *span) {
+  RectSpan rest = *span;
+
+  if (gpu->blend_mode == GpuNoTexture) {
+    __m128i color = _mm_set1_epi16(span->color);
+    for (; rest.count >= 8; rest.count -= 8, rest.target += 8)
+      _mm_storeu_si128((__m128i *)rest.target, color);
+  } else {
+    for (; rest.count >= 8; rest.count -= 8, rest.target += 8, rest.u += 8) {
+      uint16_t texel[8];
+      for (int lane = 0; lane < 8; lane++)
+        texel[lane] = get_texel(gpu, rest.u + lane, rest.v, gpu->texture_depth);
+
+      __m128i t = _mm_loadu_si128((__m128i const *)texel);
+      __m128i opaque = _mm_xor_si128(_mm_cmpeq_epi16(t, _mm_setzero_si128()), _mm_set1_epi16(-1));
+      sse2_store_masked(rest.target, t, opaque);
+    }
+  }
+
+  scalar_rect_span(gpu, &rest);
+}
+
+RasterKernels const sse2_kernels = {
+  "sse2",
+  sse2_tri_span,
+  sse2_rect_span
+};
+
+static inline AVX2 __m256i avx2_attr(__m256i value) {
+  return _mm256_max_epi32(_mm256_srai_epi32(value, 16), _mm256_setzero_si256());
+}
+
+static inline AVX2 __m256i avx2_color_555(__m256i r, __m256i g, __m256i b) {
+  __m256i mask = _mm256_set1_epi32(0xF8);
+
+  return _mm256_or_si256(
+    _mm256_or_si256(
+      _mm256_slli_epi32(_mm256_and_si256(r, mask), 7),
+      _mm256_slli_epi32(_mm256_and_si256(g, mask), 2)),
+    _mm256_srli_epi32(_mm256_and_si256(b, mask), 3));
+}
+
+static inline AVX2 __m256i avx2_modulate(__m256i r, __m256i g, __m256i b, __m256i texel) {
+  __m256i byte = _mm256_set1_epi32(0xFF);
+  __m256i channel = _mm256_set1_epi32(0x1F);
+  __m256i limit = _mm256_set1_epi32(31);
+
+  __m256i out_b = _mm256_and_si256(texel, channel);
+  __m256i out_g = _mm256_and_si256(_mm256_srli_epi32(texel, 5), channel);
+  __m256i out_r = _mm256_and_si256(_mm256_srli_epi32(texel, 10), channel);
+  out_b = _mm256_min_epi32(limit, _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(b, byte), out_b), 7));
+  out_g = _mm256_min_epi32(limit, _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(g, byte), out_g), 7));
+  out_r = _mm256_min_epi32(limit, _mm256_srli_epi32(_mm256_mullo_epi32(_mm256_and_si256(r, byte), out_r), 7));
+
+  return _mm256_or_si256(_mm256_or_si256(_mm256_slli_epi32(out_r, 10), _mm256_slli_epi32(out_g, 5)), out_b);
+}
+
+// packus works within 128 bit lanes, so the halves need putting back in order
+static inline AVX2 __m256i avx2_pack(__m256i lo, __m256i hi) {
+  return _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xD8);
+}
+
+static inline AVX2 void avx2_store_masked(uint16_t *target, __m256i pixels, __m256i mask) {
+  __m256i old = _mm256_loadu_si256((__m256i const *)target);
+  _mm256_storeu_si256((__m256i *)target, _mm256_blendv_epi8(old, pixels, mask));
+}
+
+// Color and coverage of 8 pixels
+static inline AVX2 void avx2_tri_pixels(Gpu *gpu, __m256i const value[SpanValueCount], __m256i *color, __m256i *covered) {
+  __m256i w = _mm256_or_si256(_mm256_or_si256(value[SpanW0], value[SpanW1]), value[SpanW2]);
+  *covered = _mm256_cmpgt_epi32(w, _mm256_set1_epi32(-1));
+
+  __m256i r = avx2_attr(value[SpanR]);
+  __m256i g = avx2_attr(value[SpanG]);
+  __m256i b = avx2_attr(value[SpanB]);
+
+  if (gpu->blend_mode == GpuNoTexture) {
+    *color = avx2_color_555(r, g, b);
+    return;
+  }
+
+  uint32_t u[8], v[8], mask[8], texel[8];
+  _mm256_storeu_si256((__m256i *)u, avx2_attr(value[SpanU]));
+  _mm256_storeu_si256((__m256i *)v, avx2_attr(value[SpanV]));
+  _mm256_storeu_si256((__m256i *)mask, *covered);
+  for (int lane = 0; lane < 8; lane++)
+    texel[lane] = mask[lane] ? get_texel(gpu, u[lane], v[lane], gpu->texture_depth) : 0;
+
+  __m256i t = _mm256_loadu_si256((__m256i const *)texel);
+  if (gpu->blend_mode == GpuBlendedTexture)
+    t = avx2_modulate(r, g, b, t);
+
+  *color = t;
+  // Black texels are transparent
+  *covered = _mm256_andnot_si256(_mm256_cmpeq_epi32(t, _mm256_setzero_si256()), *covered);
+}
+
+static AVX2 void avx2_tri_span(Gpu *gpu, TriSpan const *span) {
+  TriSpan rest = *span;
+  __m256i offset[SpanValueCount][2];
+
+  for (int k = 0; k < SpanValueCount; k++) {
+    uint32_t dx = span->dx[k];
+    offset[k][0] = _mm256_mullo_epi32(_mm256_set1_epi32(dx), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    offset[k][1] = _mm256_add_epi32(offset[k][0], _mm256_set1_epi32(8 * dx));
+  }
+
+  while (rest.count >= 16) {
+    __m256i color[2], covered[2];
+
+    for (int half = 0; half < 2; half++) {
+      __m256i value[SpanValueCount];
+      for (int k = 0; k < SpanValueCount; k++)
+        value[k] = _mm256_add_epi32(_mm256_set1_epi32(rest.value[k]), offset[k][half]);
+      avx2_tri_pixels(gpu, value, &color[half], &covered[half]);
+    }
+
+    avx2_store_masked(rest.target, avx2_pack(color[0], color[1]), _mm256_permute4x64_epi64(_mm256_packs_epi32(covered[0], covered[1]), 0xD8));
+    advance_tri_span(&rest, 16);
+  }
+
+  scalar_tri_span(gpu, &rest);
+}
+
+static AVX2 void avx2_rect_span(Gpu *gpu, RectSpan const *span) {
+  RectSpan rest = *span;
+
+  if (gpu->blend_mode == GpuNoTexture) {
+    __m256i color = _mm256_set1_epi16(span->color);
+    for (; rest.count >= 16; rest.count -= 16, rest.target += 16)
+      _mm256_storeu_si256((__m256i *)rest.target, color);
+  } else {
+    for (; rest.count >= 16; rest.count -= 16, rest.target += 16, rest.u += 16) {
+      uint16_t texel[16];
+      for (int lane = 0; lane < 16; lane++)
+        texel[lane] = get_texel(gpu, rest.u + lane, rest.v, gpu->texture_depth);
+
+      __m256i t = _mm256_loadu_si256((__m256i const *)texel);
+      __m256i opaque = _mm256_xor_si256(_mm256_cmpeq_epi16(t, _mm256_setzero_si256()), _mm256_set1_epi16(-1));
+      avx2_store_masked(rest.target, t, opaque);
+    }
+  }
+
+  scalar_rect_span(gpu, &rest);
+}
+
+RasterKernels const avx2_kernels = {
+  "avx2",
+  avx2_tri_span,
+  avx2_rect_span
+};
+
+#endif
@@ -0,0 +1,376 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "rewind.h"
+#include "rle.h"
+#include "log.h"
+
+static void *rewind_worker(void *arg);
+
+static uint8_t *rewind_alloc(size_t size) {
+  uint8_t *data = malloc(size);
+
+  if (data == NULL)
+    fatal("MemoryError: Couldn't allocate rewind buffer");
+
+  return data;
+}
+
+static inline size_t page_span(uint64_t section_size, uint32_t page) {
+  uint64_t size = section_size - ((uint64_t)page << DIRTY_PAGE_SHIFT);
+
+  return (size > DIRTY_PAGE_SIZE) ? DIRTY_PAGE_SIZE : size;
+}
+
+// Copies the pages set in `pages` of a section of `size` bytes
+static void copy_pages(uint8_t *to, uint8_t const *from, DirtyMap const *pages, uint64_t size) {
+  for (uint32_t page = 0; page < pages->page_count; page++) {
+    if (page_dirty(pages, page)) {
+      size_t offset = (size_t)page << DIRTY_PAGE_SHIFT;
+      memcpy(to + offset, from + offset, page_span(size, page));
+    }
+  }
+}
+
+static inline RewindEntry *rewind_entry(Rewind *rewind, uint32_t index) {
+  return &rewind->entries[(rewind->first + index) % rewind->capacity];
+}
+
+void init_rewind(Rewind *rewind, Cpu *cpu, uint32_t capacity, size_t memory_cap) {
+  if (capacity == 0)
+    fatal("ArgError: Rewind needs room for at least one state");
+
+  rewind->snapshot = init_snapshot(cpu);
+  rewind->dropped = 0;
+
+  Snapshot *snapshot = &rewind->snapshot;
+  rewind->payload_capacity = 0;
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    uint64_t size = snapshot->sizes[index];
+
+    rewind->pending[index] = init_dirty_map(size);
+    clear_dirty(&rewind->pending[index]);
+    rewind->since_keyframe[index] = init_dirty_map(size);
+    clear_dirty(&rewind->since_keyframe[index]);
+    rewind->current[index] = rewind_alloc(size);
+    memcpy(rewind->current[index], snapshot->sections[index], size);
+    rewind->keyframe[index] = rewind_alloc(size);
+    for (size_t job = 0; job < REWIND_JOB_COUNT; job++) {
+      rewind->jobs[job].sections[index] = rewind_alloc(size);
+      rewind->jobs[job].pages[index] = rewind->pending[index];
+    }
+
+    rewind->payload_capacity += size + sizeof rewind->pending[index].bits;
+  }
+  rewind->payload = rewind_alloc(rewind->payload_capacity);
+  rewind->compressed = rewind_alloc(rle_bound(rewind->payload_capacity));
+
+  // Keep groups small enough that evicting the oldest one leaves most
+  // of the ring intact
+  rewind->keyframe_interval = capacity / 4;
+  if (rewind->keyframe_interval > REWIND_KEYFRAME_INTERVAL)
+    rewind->keyframe_interval = REWIND_KEYFRAME_INTERVAL;
+  if (rewind->keyframe_interval == 0)
+    rewind->keyframe_interval = 1;
+  rewind->since_keyframe_count = 0;
+  rewind->force_keyframe = true;
+
+  rewind->entries = calloc(capacity, sizeof(RewindEntry));
+  if (rewind->entries == NULL)
+    fatal("MemoryError: Couldn't allocate rewind buffer");
+  rewind->capacity = capacity;
+  rewind->first = 0;
+  rewind->count = 0;
+  rewind->keyframe_count = 0;
+  rewind->memory_used = 0;
+  rewind->memory_cap = memory_cap;
+
+  rewind->job_head = 0;
+  rewind->job_tail = 0;
+  rewind->busy = false;
+  rewind->quit = false;
+  pthread_mutex_init(&rewind->lock, NULL);
+  pthread_cond_init(&rewind->job_ready, NULL);
+  pthread_cond_init(&rewind->job_done, NULL);
+  if (pthread_create(&rewind->worker, NULL, rewind_worker, rewind) != 0)
+    fatal("ThreadError: Couldn't start the rewind worker");
+}
+
+void rewind_capture(Rewind *rewind, Cpu *cpu) {
+  Snapshot *snapshot = &rewind->snapshot;
+
+  snapshot_update(snapshot, cpu);
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    if (snapshot->paged[index])
+      merge_dirty(&rewind->pending[index], &snapshot->changed[index]);
+  }
+
+  pthread_mutex_lock(&rewind->lock);
+  bool full = rewind->job_head - rewind->job_tail == REWIND_JOB_COUNT;
+  pthread_mutex_unlock(&rewind->lock);
+
+  // The pending pages carry over to the next capture
+  if (full) {
+    rewind->dropped++;
+    return;
+  }
+
+  RewindJob *job = &rewind->jobs[rewind->job_head % REWIND_JOB_COUNT];
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    if (snapshot->paged[index]) {
+      copy_pages(job->sections[index], snapshot->sections[index], &rewind->pending[index], snapshot->sizes[index]);
+      job->pages[index] = rewind->pending[index];
+      clear_dirty(&rewind->pending[index]);
+    } else
+      memcpy(job->sections[index], snapshot->sections[index], snapshot->sizes[index]);
+  }
+
+  pthread_mutex_lock(&rewind->lock);
+  rewind->job_head++;
+  pthread_cond_signal(&rewind->job_ready);
+  pthread_mutex_unlock(&rewind->lock);
+}
+
+static void free_entry(Rewind *rewind, RewindEntry *entry) {
+  rewind->memory_used -= entry->size;
+  if (entry->keyframe)
+    rewind->keyframe_count--;
+  free(entry->data);
+  entry->data = NULL;
+}
+
+// Deltas depend on the keyframe before them, so entries are evicted a
+// keyframe and its deltas at a time
+static void evict_oldest_group(Rewind *rewind) {
+  do {
+    free_entry(rewind, rewind_entry(rewind, 0));
+    rewind->first = (rewind->first + 1) % rewind->capacity;
+    rewind->count--;
+  } while (rewind->count > 0 && !rewind_entry(rewind, 0)->keyframe);
+}
+
+static void store_entry(Rewind *rewind, bool keyframe, size_t size, size_t raw_size) {
+  // A delta can't outlive its keyframe, which is in the newest group
+  while (rewind->count > 0 && (keyframe || rewind->keyframe_count > 1) &&
+      (rewind->count == rewind->capacity || rewind->memory_used + size > rewind->memory_cap))
+    evict_oldest_group(rewind);
+
+  if (rewind->count == rewind->capacity || rewind->memory_used + size > rewind->memory_cap) {
+    // Deltas can't follow a keyframe that was never stored
+    if (keyframe)
+      rewind->force_keyframe = true;
+    return;
+  }
+
+  RewindEntry *entry = rewind_entry(rewind, rewind->count);
+  entry->data = rewind_alloc(size);
+  memcpy(entry->data, rewind->compressed, size);
+  entry->size = size;
+  entry->raw_size = raw_size;
+  entry->keyframe = keyframe;
+
+  rewind->count++;
+  rewind->memory_used += size;
+  if (keyframe)
+    rewind->keyframe_count++;
+}
+
+static void encode_job(Rewind *rewind, RewindJob const *job) {
+  Snapshot const *snapshot = &rewind->snapshot;
+
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    if (snapshot->paged[index]) {
+      copy_pages(rewind->current[index], job->sections[index], &job->pages[index], snapshot->sizes[index]);
+      merge_dirty(&rewind->since_keyframe[index], &job->pages[index]);
+    } else
+      memcpy(rewind->current[index], job->sections[index], snapshot->sizes[index]);
+  }
+
+  bool keyframe = rewind->force_keyframe || rewind->since_keyframe_count + 1 >= rewind->keyframe_interval;
+  uint8_t *payload = rewind->payload;
+  size_t size = 0;
+
+  if (keyframe) {
+    for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+      memcpy(rewind->keyframe[index], rewind->current[index], snapshot->sizes[index]);
+      memcpy(payload + size, rewind->current[index], snapshot->sizes[index]);
+      size += snapshot->sizes[index];
+      clear_dirty(&rewind->since_keyframe[index]);
+    }
+    rewind->since_keyframe_count = 0;
+    rewind->force_keyframe = false;
+  } else {
+    // Paged sections are stored as the pages changed since the keyframe,
+    // XORed with it so unchanged bytes compress away
+    for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+      if (!snapshot->paged[index]) {
+        memcpy(payload + size, rewind->current[index], snapshot->sizes[index]);
+        size += snapshot->sizes[index];
+        continue;
+      }
+
+      DirtyMap const *pages = &rewind->since_keyframe[index];
+      memcpy(payload + size, pages->bits, sizeof pages->bits);
+      size += sizeof pages->bits;
+
+      for (uint32_t page = 0; page < pages->page_count; page++) {
+        if (!page_dirty(pages, page))
+          continue;
+
+        size_t offset = (size_t)page << DIRTY_PAGE_SHIFT;
+        size_t span = page_span(snapshot->sizes[index], page);
+        for (size_t byte = 0; byte < span; byte++)
+          payload[size + byte] = rewind->current[index][offset + byte] ^ rewind->keyframe[index][offset + byte];
+        size += span;
+      }
+    }
+    rewind->since_keyframe_count++;
+  }
+
+  store_entry(rewind, keyframe, rle_compress(payload, size, rewind->compressed), size);
+}
+
+static void *rewind_worker(void *arg) {
+  Rewind *rewind = arg;
+
+  pthread_mutex_lock(&rewind->lock);
+  while (1) {
+    while (!rewind->quit && rewind->job_head == rewind->job_tail)
+      pthread_cond_wait(&rewind->job_ready, &rewind->lock);
+
+    if (rewind->job_head == rewind->job_tail)
+      break;
+
+    RewindJob const *job = &rewind->jobs[rewind->job_tail % REWIND_JOB_COUNT];
+    rewind->busy = true;
+    pthread_mutex_unlock(&rewind->lock);
+
+    encode_job(rewind, job);
+
+    pthread_mutex_lock(&rewind->lock);
+    rewind->job_tail++;
+    rewind->busy = false;
+    pthread_cond_broadcast(&rewind->job_done);
+  }
+  pthread_mutex_unlock(&rewind->lock);
+
+  return NULL;
+}
+
+// Waits for the worker to finish every job. Called with the lock held.
+static void drain_jobs(Rewind *rewind) {
+  while (rewind->job_head != rewind->job_tail || rewind->busy)
+    pthread_cond_wait(&rewind->job_done, &rewind->lock);
+}
+
+uint32_t rewind_count(Rewind *rewind) {
+  pthread_mutex_lock(&rewind->lock);
+  drain_jobs(rewind);
+  uint32_t count = rewind->count;
+  pthread_mutex_unlock(&rewind->lock);
+
+  return count;
+}
+
+static void decode_entry(Rewind *rewind, RewindEntry const *entry) {
+  if (!rle_decompress(entry->data, entry->size, rewind->payload, entry->raw_size))
+    fatal("StateError: Corrupt rewind entry");
+}
+
+bool rewind_restore(Rewind *rewind, Cpu *cpu, uint32_t steps) {
+  pthread_mutex_lock(&rewind->lock);
+  drain_jobs(rewind);
+
+  if (steps >= rewind->count) {
+    pthread_mutex_unlock(&rewind->lock);
+    return false;
+  }
+
+  uint32_t target = rewind->count - 1 - steps;
+  uint32_t key = target;
+  while (!rewind_entry(rewind, key)->keyframe)
+    key--;
+
+  Snapshot *snapshot = &rewind->snapshot;
+  uint8_t const *payload = rewind->payload;
+
+  decode_entry(rewind, rewind_entry(rewind, key));
+  size_t offset = 0;
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    memcpy(snapshot->sections[index], payload + offset, snapshot->sizes[index]);
+    offset += snapshot->sizes[index];
+  }
+
+  if (target != key) {
+    decode_entry(rewind, rewind_entry(rewind, target));
+    offset = 0;
+    for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+      if (!snapshot->paged[index]) {
+        memcpy(snapshot->sections[index], payload + offset, snapshot->sizes[index]);
+        offset += snapshot->sizes[index];
+        continue;
+      }
+
+      DirtyMap pages = init_dirty_map(snapshot->sizes[index]);
+      memcpy(pages.bits, payload + offset, sizeof pages.bits);
+      offset += sizeof pages.bits;
+
+      for (uint32_t page = 0; page < pages.page_count; page++) {
+        if (!page_dirty(&pages, page))
+          continue;
+
+        uint8_t *section = snapshot->sections[index] + ((size_t)page << DIRTY_PAGE_SHIFT);
+        size_t span = page_span(snapshot->sizes[index], page);
+        for (size_t byte = 0; byte < span; byte++)
+          section[byte] ^= payload[offset + byte];
+        offset += span;
+      }
+    }
+  }
+
+  snapshot_load(snapshot, cpu);
+
+  // Later states belong to a timeline that's gone now, and the worker
+  // carries on from the restored state
+  while (rewind->count > target + 1) {
+    free_entry(rewind, rewind_entry(rewind, rewind->count - 1));
+    rewind->count--;
+  }
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    memcpy(rewind->current[index], snapshot->sections[index], snapshot->sizes[index]);
+    clear_dirty(&rewind->pending[index]);
+  }
+  rewind->force_keyframe = true;
+
+  pthread_mutex_unlock(&rewind->lock);
+
+  return true;
+}
+
+void destroy_rewind(Rewind *rewind) {
+  pthread_mutex_lock(&rewind->lock);
+  rewind->quit = true;
+  pthread_cond_signal(&rewind->job_ready);
+  pthread_mutex_unlock(&rewind->lock);
+  pthread_join(rewind->worker, NULL);
+
+  while (rewind->count > 0) {
+    free_entry(rewind, rewind_entry(rewind, rewind->count - 1));
+    rewind->count--;
+  }
+  free(rewind->entries);
+
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    free(rewind->current[index]);
+    free(rewind->keyframe[index]);
+    for (size_t job = 0; job < REWIND_JOB_COUNT; job++)
+      free(rewind->jobs[job].sections[index]);
+  }
+  free(rewind->payload);
+  free(rewind->compressed);
+  destroy_snapshot(&rewind->snapshot);
+
+  pthread_mutex_destroy(&rewind->lock);
+  pthread_cond_destroy(&rewind->job_ready);
+  pthread_cond_destroy(&rewind->job_done);
+}
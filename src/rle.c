@@ -0,0 +1,73 @@
+#include <string.h>
+
+#include "rle.h"
+
+static size_t run_length(uint8_t const *src, size_t size) {
+  size_t length = 1;
+
+  while (length < size && length < RLE_MAX_RUN && src[length] == src[0])
+    length++;
+
+  return length;
+}
+
+static inline bool starts_run(uint8_t const *src, size_t size) {
+  return size >= RLE_MIN_RUN && src[1] == src[0] && src[2] == src[0];
+}
+
+size_t rle_compress(uint8_t const *src, size_t size, uint8_t *dst) {
+  size_t in = 0, out = 0;
+
+  while (in < size) {
+    if (starts_run(src + in, size - in)) {
+      size_t run = run_length(src + in, size - in);
+      size_t count = run - RLE_MIN_RUN;
+      dst[out++] = 0x80 | (count >> 8);
+      dst[out++] = count;
+      dst[out++] = src[in];
+      in += run;
+      continue;
+    }
+
+    // Gather literals up to the next run worth encoding
+    size_t literal = 0;
+    while (in + literal < size && literal < RLE_MAX_LITERAL &&
+        !starts_run(src + in + literal, size - in - literal))
+      literal++;
+
+    dst[out++] = literal - 1;
+    memcpy(dst + out, src + in, literal);
+    out += literal;
+    in += literal;
+  }
+
+  return out;
+}
+
+bool rle_decompress(uint8_t const *src, size_t size, uint8_t *dst, size_t dst_size) {
+  size_t in = 0, out = 0;
+
+  while (in < size) {
+    uint8_t control = src[in++];
+
+    if (control < 0x80) {
+      size_t literal = control + 1;
+      if (in + literal > size || out + literal > dst_size)
+        return false;
+      memcpy(dst + out, src + in, literal);
+      in += literal;
+      out += literal;
+    } else {
+      if (in + 2 > size)
+        return false;
+      size_t run = (((control & 0x7F) << 8) | src[in]) + RLE_MIN_RUN;
+      if (out + run > dst_size)
+        return false;
+      memset(dst + out, src[in + 1], run);
+      in += 2;
+      out += run;
+    }
+  }
+
+  return out == dst_size;
+}
@@ -0,0 +1,562 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "savestate.h"
+#include "byteorder.h"
+#include "log.h"
+
+static char const state_magic[8] = "PSXSTATE";
+
+typedef enum StateMode {
+  StateMeasure,
+  StateSave,
+  StateLoad
+} StateMode;
+
+// Walks the fields of a section, writing them to `data` or reading them
+// back as fixed-width little-endian values, so the layout doesn't depend
+// on the host compiler. Measuring only counts the bytes.
+typedef struct StateCursor {
+  StateMode mode;
+  uint8_t *data;
+  uint64_t size;
+} StateCursor;
+
+static void state_u8(StateCursor *cursor, uint8_t *val) {
+  if (cursor->mode == StateSave)
+    cursor->data[cursor->size] = *val;
+  else if (cursor->mode == StateLoad)
+    *val = cursor->data[cursor->size];
+  cursor->size += 1;
+}
+
+static void state_u16(StateCursor *cursor, uint16_t *val) {
+  if (cursor->mode == StateSave)
+    write_le16(cursor->data + cursor->size, *val);
+  else if (cursor->mode == StateLoad)
+    *val = read_le16(cursor->data + cursor->size);
+  cursor->size += 2;
+}
+
+static void state_u32(StateCursor *cursor, uint32_t *val) {
+  if (cursor->mode == StateSave)
+    write_le32(cursor->data + cursor->size, *val);
+  else if (cursor->mode == StateLoad)
+    *val = read_le32(cursor->data + cursor->size);
+  cursor->size += 4;
+}
+
+static void state_u64(StateCursor *cursor, uint64_t *val) {
+  uint32_t low = *val;
+  uint32_t high = *val >> 32;
+
+  state_u32(cursor, &low);
+  state_u32(cursor, &high);
+  *val = ((uint64_t)high << 32) | low;
+}
+
+// Stores `field`, whatever its type, as a `width` bit unsigned value
+#define STATE_FIELD(cursor, width, field) do { \
+    uint##width##_t state_field = (field); \
+    state_u##width(cursor, &state_field); \
+    (field) = state_field; \
+  } while (0)
+
+static void visit_header(StateCursor *cursor, StateHeader *header) {
+  for (size_t index = 0; index < sizeof header->magic; index++)
+    STATE_FIELD(cursor, 8, header->magic[index]);
+  STATE_FIELD(cursor, 32, header->version);
+  STATE_FIELD(cursor, 32, header->section_count);
+  STATE_FIELD(cursor, 64, header->bios_hash);
+}
+
+static void visit_section_header(StateCursor *cursor, StateSectionHeader *section) {
+  STATE_FIELD(cursor, 32, section->tag);
+  STATE_FIELD(cursor, 32, section->reserved);
+  STATE_FIELD(cursor, 64, section->size);
+}
+
+static void visit_cpu(StateCursor *cursor, Cpu *cpu) {
+  STATE_FIELD(cursor, 32, cpu->pc.data);
+  STATE_FIELD(cursor, 32, cpu->next_pc.data);
+  STATE_FIELD(cursor, 32, cpu->current_pc.data);
+  for (size_t index = 0; index < sizeof cpu->regs / sizeof cpu->regs[0]; index++)
+    STATE_FIELD(cursor, 32, cpu->regs[index]);
+  STATE_FIELD(cursor, 32, cpu->bad_v_adr.data);
+  STATE_FIELD(cursor, 32, cpu->sr);
+  STATE_FIELD(cursor, 32, cpu->cause);
+  STATE_FIELD(cursor, 32, cpu->epc.data);
+  STATE_FIELD(cursor, 32, cpu->hi);
+  STATE_FIELD(cursor, 32, cpu->lo);
+  STATE_FIELD(cursor, 8, cpu->load_delay_slot.index.data);
+  STATE_FIELD(cursor, 32, cpu->load_delay_slot.val);
+  STATE_FIELD(cursor, 8, cpu->branch);
+  STATE_FIELD(cursor, 8, cpu->delay_slot);
+}
+
+static void visit_clock(StateCursor *cursor, Cpu *cpu) {
+  Clock *clock = &cpu->shared.clock;
+
+  STATE_FIELD(cursor, 64, clock->now.data);
+  STATE_FIELD(cursor, 64, clock->next_sync.data);
+  for (size_t index = 0; index < PeripheralCount; index++) {
+    STATE_FIELD(cursor, 64, clock->peripheral_clocks[index].last_sync.data);
+    STATE_FIELD(cursor, 64, clock->peripheral_clocks[index].next_sync.data);
+  }
+}
+
+static void visit_dma(StateCursor *cursor, Cpu *cpu) {
+  Dma *dma = &cpu->inter.dma;
+
+  STATE_FIELD(cursor, 32, dma->control);
+  STATE_FIELD(cursor, 8, dma->irq_master_en);
+  STATE_FIELD(cursor, 8, dma->irq_channel_en);
+  STATE_FIELD(cursor, 8, dma->irq_channel_flags);
+  STATE_FIELD(cursor, 8, dma->irq_force);
+  STATE_FIELD(cursor, 8, dma->irq_dummy);
+  for (size_t index = 0; index < DmaChannelCount; index++) {
+    DmaChannel *channel = &dma->channels[index];
+    STATE_FIELD(cursor, 8, channel->enable);
+    STATE_FIELD(cursor, 8, channel->direction);
+    STATE_FIELD(cursor, 8, channel->step);
+    STATE_FIELD(cursor, 8, channel->sync);
+    STATE_FIELD(cursor, 8, channel->trigger);
+    STATE_FIELD(cursor, 8, channel->chop);
+    STATE_FIELD(cursor, 8, channel->chop_dma_size);
+    STATE_FIELD(cursor, 8, channel->chop_cpu_size);
+    STATE_FIELD(cursor, 8, channel->dummy);
+    STATE_FIELD(cursor, 32, channel->base_address.data);
+    STATE_FIELD(cursor, 16, channel->block_size);
+    STATE_FIELD(cursor, 16, channel->block_count);
+    STATE_FIELD(cursor, 8, channel->port);
+  }
+}
+
+// The renderer and the host fields are left alone, and gp0_method is
+// rebuilt from the command buffer by finish_restore
+static void visit_gpu(StateCursor *cursor, Cpu *cpu) {
+  Gpu *gpu = &cpu->inter.gpu;
+
+  STATE_FIELD(cursor, 16, gpu->texture_page[0]);
+  STATE_FIELD(cursor, 16, gpu->texture_page[1]);
+  STATE_FIELD(cursor, 16, gpu->clut[0]);
+  STATE_FIELD(cursor, 16, gpu->clut[1]);
+  STATE_FIELD(cursor, 8, gpu->semi_transparent);
+  STATE_FIELD(cursor, 8, gpu->semi_transparency_mode);
+  STATE_FIELD(cursor, 8, gpu->texture_depth);
+  STATE_FIELD(cursor, 8, gpu->blend_mode);
+  STATE_FIELD(cursor, 8, gpu->dithering);
+  STATE_FIELD(cursor, 8, gpu->draw_to_display);
+  STATE_FIELD(cursor, 8, gpu->force_set_mask_bit);
+  STATE_FIELD(cursor, 8, gpu->preserve_masked_pixels);
+  STATE_FIELD(cursor, 8, gpu->interlace_field);
+  STATE_FIELD(cursor, 8, gpu->texture_disabled);
+  STATE_FIELD(cursor, 8, gpu->hres.data);
+  STATE_FIELD(cursor, 8, gpu->vres);
+  STATE_FIELD(cursor, 8, gpu->video_mode);
+  STATE_FIELD(cursor, 8, gpu->display_depth);
+  STATE_FIELD(cursor, 8, gpu->interlaced);
+  STATE_FIELD(cursor, 8, gpu->display_disabled);
+  STATE_FIELD(cursor, 8, gpu->interrupt_active);
+  STATE_FIELD(cursor, 8, gpu->dma_direction);
+  STATE_FIELD(cursor, 8, gpu->rectangle_texture_x_flip);
+  STATE_FIELD(cursor, 8, gpu->rectangle_texture_y_flip);
+  STATE_FIELD(cursor, 8, gpu->texture_window_x_mask);
+  STATE_FIELD(cursor, 8, gpu->texture_window_y_mask);
+  STATE_FIELD(cursor, 8, gpu->texture_window_x_offset);
+  STATE_FIELD(cursor, 8, gpu->texture_window_y_offset);
+  STATE_FIELD(cursor, 16, gpu->drawing_area_left);
+  STATE_FIELD(cursor, 16, gpu->drawing_area_top);
+  STATE_FIELD(cursor, 16, gpu->drawing_area_right);
+  STATE_FIELD(cursor, 16, gpu->drawing_area_bottom);
+  STATE_FIELD(cursor, 16, gpu->drawing_x_offset);
+  STATE_FIELD(cursor, 16, gpu->drawing_y_offset);
+  STATE_FIELD(cursor, 16, gpu->display_vram_x_start);
+  STATE_FIELD(cursor, 16, gpu->display_vram_y_start);
+  STATE_FIELD(cursor, 16, gpu->display_hor_start);
+  STATE_FIELD(cursor, 16, gpu->display_hor_end);
+  STATE_FIELD(cursor, 16, gpu->display_line_start);
+  STATE_FIELD(cursor, 16, gpu->display_line_end);
+  for (size_t index = 0; index < sizeof gpu->gp0_command_buffer.commands / sizeof(uint32_t); index++)
+    STATE_FIELD(cursor, 32, gpu->gp0_command_buffer.commands[index]);
+  STATE_FIELD(cursor, 8, gpu->gp0_command_buffer.command_count);
+  STATE_FIELD(cursor, 32, gpu->gp0_words_remaining);
+  STATE_FIELD(cursor, 8, gpu->gp0_mode);
+  STATE_FIELD(cursor, 16, gpu->image_buffer.left);
+  STATE_FIELD(cursor, 16, gpu->image_buffer.top);
+  STATE_FIELD(cursor, 16, gpu->image_buffer.width);
+  STATE_FIELD(cursor, 16, gpu->image_buffer.height);
+  STATE_FIELD(cursor, 16, gpu->image_buffer.x);
+  STATE_FIELD(cursor, 16, gpu->image_buffer.y);
+  STATE_FIELD(cursor, 32, gpu->read_word);
+}
+
+static void visit_timers(StateCursor *cursor, Cpu *cpu) {
+  for (size_t index = 0; index < sizeof cpu->inter.timers.timers / sizeof(Timer); index++) {
+    Timer *timer = &cpu->inter.timers.timers[index];
+    STATE_FIELD(cursor, 8, timer->timer_instance);
+    STATE_FIELD(cursor, 16, timer->counter);
+    STATE_FIELD(cursor, 16, timer->target);
+    STATE_FIELD(cursor, 8, timer->use_sync);
+    STATE_FIELD(cursor, 8, timer->sync_mode);
+    STATE_FIELD(cursor, 8, timer->target_wrap);
+    STATE_FIELD(cursor, 8, timer->target_irq);
+    STATE_FIELD(cursor, 8, timer->wrap_irq);
+    STATE_FIELD(cursor, 8, timer->repeat_irq);
+    STATE_FIELD(cursor, 8, timer->negate_irq);
+    STATE_FIELD(cursor, 8, timer->clock_source.data);
+    STATE_FIELD(cursor, 8, timer->target_reached);
+    STATE_FIELD(cursor, 8, timer->overflow_reached);
+    STATE_FIELD(cursor, 64, timer->period.data);
+    STATE_FIELD(cursor, 64, timer->phase.data);
+    STATE_FIELD(cursor, 8, timer->interrupt);
+  }
+}
+
+static void visit_icache(StateCursor *cursor, Cpu *cpu) {
+  ICache *icache = &cpu->inter.icache;
+
+  STATE_FIELD(cursor, 32, icache->control);
+  for (size_t index = 0; index < ICACHE_LINE_COUNT; index++) {
+    ICacheLine *line = &icache->lines[index];
+    STATE_FIELD(cursor, 32, line->tag);
+    STATE_FIELD(cursor, 8, line->valid);
+    for (size_t word = 0; word < ICACHE_LINE_WORDS; word++)
+      STATE_FIELD(cursor, 32, line->data[word]);
+  }
+}
+
+typedef void (*StateVisitor)(StateCursor *cursor, Cpu *cpu);
+
+// Sections are either walked field by field by `visit`, or are guest
+// memory copied as is from `data`, with `dirty` tracking their pages
+typedef struct StateSection {
+  uint32_t tag;
+  StateVisitor visit;
+  void *data;
+  uint64_t size;
+  DirtyMap *dirty;
+  long offset;
+} StateSection;
+
+static void visit_section(StateSection const *section, Cpu *cpu, StateMode mode, uint8_t *data) {
+  StateCursor cursor = {mode, data, 0};
+
+  section->visit(&cursor, cpu);
+}
+
+static void state_sections(Cpu *cpu, StateSection *sections) {
+  // Every entry point starts here, so the render thread is idle while
+  // the sections are read or overwritten
+  gpu_sync(&cpu->inter.gpu);
+
+  StateSection const list[STATE_SECTION_COUNT] = {
+    [StateCpu] = {STATE_TAG('C', 'P', 'U', ' '), visit_cpu},
+    [StateClock] = {STATE_TAG('C', 'L', 'C', 'K'), visit_clock},
+    [StateDma] = {STATE_TAG('D', 'M', 'A', ' '), visit_dma},
+    [StateGpu] = {STATE_TAG('G', 'P', 'U', ' '), visit_gpu},
+    [StateTimers] = {STATE_TAG('T', 'I', 'M', 'R'), visit_timers},
+    [StateICache] = {STATE_TAG('I', 'C', 'A', 'C'), visit_icache},
+    [StateRam] = {STATE_TAG('R', 'A', 'M', ' '), NULL, ram_host_ptr(&cpu->inter.ram, 0), RAM_PHYSICAL_SIZE, &cpu->inter.ram.dirty},
+    [StateScratchpad] = {STATE_TAG('S', 'P', 'A', 'D'), NULL, cpu->inter.pad.data, range(SCRATCH_PAD).size, &cpu->inter.pad.dirty},
+    [StateVram] = {STATE_TAG('V', 'R', 'A', 'M'), NULL, vram_pixels(&cpu->inter.gpu.renderer), VRAM_WIDTH * VRAM_HEIGHT * sizeof(uint16_t), &cpu->inter.gpu.renderer.vram_dirty}
+  };
+
+  memcpy(sections, list, sizeof list);
+
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    if (sections[index].visit) {
+      StateCursor cursor = {StateMeasure, NULL, 0};
+      sections[index].visit(&cursor, cpu);
+      sections[index].size = cursor.size;
+    }
+  }
+}
+
+static void finish_restore(Cpu *cpu) {
+  gpu_restore_gp0_method(&cpu->inter.gpu);
+
+  cpu->fetch_page = NULL;
+  cpu->idle_loop.branch_pc = MAKE_Addr(0x0);
+  cpu->idle_loop.candidate = false;
+}
+
+static bool write_header(FILE *fp, StateHeader *header) {
+  uint8_t data[STATE_HEADER_SIZE];
+  StateCursor cursor = {StateSave, data, 0};
+
+  visit_header(&cursor, header);
+
+  return fwrite(data, sizeof data, 1, fp) == 1;
+}
+
+static bool write_section_header(FILE *fp, StateSectionHeader *section) {
+  uint8_t data[STATE_SECTION_HEADER_SIZE];
+  StateCursor cursor = {StateSave, data, 0};
+
+  visit_section_header(&cursor, section);
+
+  return fwrite(data, sizeof data, 1, fp) == 1;
+}
+
+bool write_state(Cpu *cpu, FILE *fp) {
+  StateSection sections[STATE_SECTION_COUNT];
+  state_sections(cpu, sections);
+
+  StateHeader header = {{0}};
+  memcpy(header.magic, state_magic, sizeof header.magic);
+  header.version = STATE_VERSION;
+  header.section_count = STATE_SECTION_COUNT;
+  header.bios_hash = bios_hash(&cpu->inter.bios);
+
+  bool ok = write_header(fp, &header);
+
+  for (size_t index = 0; ok && index < STATE_SECTION_COUNT; index++) {
+    StateSectionHeader section = {sections[index].tag, 0, sections[index].size};
+    ok = write_section_header(fp, &section);
+    if (!ok)
+      break;
+
+    if (sections[index].visit) {
+      uint8_t *data = malloc(sections[index].size);
+      if (data == NULL)
+        fatal("MemoryError: Couldn't allocate save state section");
+      visit_section(&sections[index], cpu, StateSave, data);
+      ok = fwrite(data, sections[index].size, 1, fp) == 1;
+      free(data);
+    } else
+      ok = fwrite(sections[index].data, sections[index].size, 1, fp) == 1;
+  }
+
+  if (fclose(fp) != 0)
+    ok = false;
+
+  return ok;
+}
+
+bool save_state(Cpu *cpu, char const *filename) {
+  FILE * const fp = fopen(filename, "wb");
+
+  if (!fp || !write_state(cpu, fp)) {
+    log_error("IOError: Couldn't write save state: %s", filename);
+    return false;
+  }
+
+  return true;
+}
+
+static bool read_header(FILE *fp, StateHeader *header) {
+  uint8_t data[STATE_HEADER_SIZE];
+  StateCursor cursor = {StateLoad, data, 0};
+
+  if (fread(data, sizeof data, 1, fp) != 1)
+    return false;
+  visit_header(&cursor, header);
+
+  return true;
+}
+
+static bool read_section_header(FILE *fp, StateSectionHeader *section) {
+  uint8_t data[STATE_SECTION_HEADER_SIZE];
+  StateCursor cursor = {StateLoad, data, 0};
+
+  if (fread(data, sizeof data, 1, fp) != 1)
+    return false;
+  visit_section_header(&cursor, section);
+
+  return true;
+}
+
+static bool load_state_error(FILE *fp, char const *filename, char const *reason) {
+  log_error("StateError: %s: %s", reason, filename);
+  fclose(fp);
+
+  return false;
+}
+
+bool load_state(Cpu *cpu, char const *filename) {
+  FILE * const fp = fopen(filename, "rb");
+
+  if (!fp) {
+    log_error("IOError: Could not open save state: %s", filename);
+    return false;
+  }
+
+  StateHeader header;
+  if (!read_header(fp, &header) || memcmp(header.magic, state_magic, sizeof header.magic) != 0)
+    return load_state_error(fp, filename, "Not a save state");
+  if (header.version != STATE_VERSION)
+    return load_state_error(fp, filename, "Unsupported save state version");
+  if (header.bios_hash != bios_hash(&cpu->inter.bios))
+    return load_state_error(fp, filename, "Save state was made with a different BIOS");
+
+  long file_size;
+  long start = ftell(fp);
+  fseek(fp, 0L, SEEK_END);
+  file_size = ftell(fp);
+  fseek(fp, start, SEEK_SET);
+
+  StateSection sections[STATE_SECTION_COUNT];
+  state_sections(cpu, sections);
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++)
+    sections[index].offset = -1;
+
+  // Find every section before touching the machine. Sections this
+  // build doesn't know about are skipped.
+  for (uint32_t count = 0; count < header.section_count; count++) {
+    StateSectionHeader section;
+    if (!read_section_header(fp, &section))
+      return load_state_error(fp, filename, "Truncated save state");
+
+    long offset = ftell(fp);
+    if (section.size > (uint64_t)(file_size - offset))
+      return load_state_error(fp, filename, "Truncated save state");
+
+    StateSection *known = NULL;
+    for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+      if (sections[index].tag == section.tag)
+        known = &sections[index];
+    }
+
+    if (known == NULL)
+      log_warn("StateError: Skipping unknown section %.4s: %s", (char const *)&section.tag, filename);
+    else if (known->size != section.size)
+      return load_state_error(fp, filename, "Save state section has the wrong size");
+    else
+      known->offset = offset;
+
+    fseek(fp, offset + section.size, SEEK_SET);
+  }
+
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    if (sections[index].offset < 0)
+      return load_state_error(fp, filename, "Save state is missing a section");
+  }
+
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    uint8_t *data = sections[index].data;
+    if (sections[index].visit) {
+      data = malloc(sections[index].size);
+      if (data == NULL)
+        fatal("MemoryError: Couldn't allocate save state section");
+    }
+
+    fseek(fp, sections[index].offset, SEEK_SET);
+    if (fread(data, sections[index].size, 1, fp) != 1)
+      fatal("IOError: Couldn't read save state: %s", filename);
+
+    if (sections[index].visit) {
+      visit_section(&sections[index], cpu, StateLoad, data);
+      free(data);
+    }
+  }
+
+  fclose(fp);
+
+  finish_restore(cpu);
+
+  // Nothing decoded or translated before the restore is valid anymore,
+  // and every page may differ from the last snapshot
+  code_cache_invalidate_range(&cpu->inter.code_cache, MAKE_Addr(0x0), RAM_PHYSICAL_SIZE);
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    if (sections[index].dirty)
+      mark_all_dirty(sections[index].dirty);
+  }
+
+  return true;
+}
+
+Snapshot init_snapshot(Cpu *cpu) {
+  Snapshot snapshot;
+  StateSection sections[STATE_SECTION_COUNT];
+  state_sections(cpu, sections);
+
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    snapshot.sections[index] = malloc(sections[index].size);
+    if (snapshot.sections[index] == NULL)
+      fatal("MemoryError: Couldn't allocate snapshot");
+    snapshot.sizes[index] = sections[index].size;
+    snapshot.paged[index] = sections[index].dirty != NULL;
+    snapshot.changed[index] = init_dirty_map(0);
+  }
+
+  snapshot_update(&snapshot, cpu);
+
+  return snapshot;
+}
+
+// Copies every dirty page of `from` over `to`
+static uint32_t copy_dirty_pages(uint8_t *to, uint8_t const *from, StateSection const *section) {
+  uint32_t copied = 0;
+
+  for (uint32_t page = 0; page < section->dirty->page_count; page++) {
+    if (!page_dirty(section->dirty, page))
+      continue;
+
+    uint64_t offset = (uint64_t)page << DIRTY_PAGE_SHIFT;
+    uint64_t size = section->size - offset;
+    if (size > DIRTY_PAGE_SIZE)
+      size = DIRTY_PAGE_SIZE;
+    memcpy(to + offset, from + offset, size);
+    copied++;
+  }
+
+  return copied;
+}
+
+uint32_t snapshot_update(Snapshot *snapshot, Cpu *cpu) {
+  StateSection sections[STATE_SECTION_COUNT];
+  state_sections(cpu, sections);
+
+  uint32_t copied = 0;
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    if (sections[index].dirty) {
+      copied += copy_dirty_pages(snapshot->sections[index], sections[index].data, &sections[index]);
+      snapshot->changed[index] = *sections[index].dirty;
+      clear_dirty(sections[index].dirty);
+    } else
+      visit_section(&sections[index], cpu, StateSave, snapshot->sections[index]);
+  }
+
+  return copied;
+}
+
+void snapshot_restore(Snapshot *snapshot, Cpu *cpu) {
+  StateSection sections[STATE_SECTION_COUNT];
+  state_sections(cpu, sections);
+
+  // Pages written since the last update are the only ones that differ.
+  // Decoded code in RAM pages that get rolled back is stale.
+  DirtyMap *ram_dirty = &cpu->inter.ram.dirty;
+  for (uint32_t page = 0; page < ram_dirty->page_count; page++) {
+    if (page_dirty(ram_dirty, page))
+      code_cache_invalidate_range(&cpu->inter.code_cache, MAKE_Addr(page << DIRTY_PAGE_SHIFT), DIRTY_PAGE_SIZE);
+  }
+
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    if (sections[index].dirty) {
+      copy_dirty_pages(sections[index].data, snapshot->sections[index], &sections[index]);
+      clear_dirty(sections[index].dirty);
+    } else
+      visit_section(&sections[index], cpu, StateLoad, snapshot->sections[index]);
+  }
+
+  finish_restore(cpu);
+}
+
+void snapshot_load(Snapshot *snapshot, Cpu *cpu) {
+  StateSection sections[STATE_SECTION_COUNT];
+  state_sections(cpu, sections);
+
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++) {
+    if (sections[index].dirty)
+      mark_all_dirty(sections[index].dirty);
+  }
+
+  snapshot_restore(snapshot, cpu);
+}
+
+void destroy_snapshot(Snapshot *snapshot) {
+  for (size_t index = 0; index < STATE_SECTION_COUNT; index++)
+    free(snapshot->sections[index]);
+}
@@ -2,6 +2,7 @@
 
 #include "scratch.h"
 #include "flag.h"
+#include "byteorder.h"
 
 Scratchpad init_scratchpad() {
   Scratchpad scratchpad;
@@ -9,28 +10,17 @@ Scratchpad init_scratchpad() {
 
   for(int index = 0; index < range(RAM).size; index++)
     scratchpad.data[index] = 0xca;
+  scratchpad.dirty = init_dirty_map(range(SCRATCH_PAD).size);
 
   return scratchpad;
 }
 
 uint32_t load_scratchpad32(Scratchpad *scratchpad, Addr offset) {
-
-  uint32_t b0 = scratchpad->data[offset.data++]; 
-  uint32_t b1 = scratchpad->data[offset.data++]; 
-  uint32_t b2 = scratchpad->data[offset.data++]; 
-  uint32_t b3 = scratchpad->data[offset.data++]; 
-
-  uint32_t ret = b0 | (b1 << 8) | (b2 << 16) | (b3 << 24);
-
-  return ret;
+  return read_le32(scratchpad->data + offset.data);
 }
 
 uint16_t load_scratchpad16(Scratchpad *scratchpad, Addr offset) {
-
-  uint16_t b0 = scratchpad->data[offset.data++];
-  uint16_t b1 = scratchpad->data[offset.data++];
-
-  return b0 | (b1 << 8);
+  return read_le16(scratchpad->data + offset.data);
 }
 
 uint8_t load_scratchpad8(Scratchpad *scratchpad, Addr offset) {
@@ -49,25 +39,11 @@ uint32_t load_scratchpad(Scratchpad *scratchpad, Addr offset, AddrType type) {
 }
 
 void store_scratchpad32(Scratchpad *scratchpad, Addr offset, uint32_t val) {
-
-  uint8_t b0 = val;
-  uint8_t b1 = val >> 8;
-  uint8_t b2 = val >> 16;
-  uint8_t b3 = val >> 24;
-
-  scratchpad->data[offset.data++] = b0; 
-  scratchpad->data[offset.data++] = b1; 
-  scratchpad->data[offset.data++] = b2; 
-  scratchpad->data[offset.data++] = b3; 
+  write_le32(scratchpad->data + offset.data, val);
 }
 
 void store_scratchpad16(Scratchpad *scratchpad, Addr offset, uint16_t val) {
-
-  uint8_t b0 = val;
-  uint8_t b1 = val >> 8;
-
-  scratchpad->data[offset.data++] = b0;
-  scratchpad->data[offset.data++] = b1;
+  write_le16(scratchpad->data + offset.data, val);
 }
 
 void store_scratchpad8(Scratchpad *scratchpad, Addr offset, uint8_t val) {
@@ -75,6 +51,8 @@ void store_scratchpad8(Scratchpad *scratchpad, Addr offset, uint8_t val) {
 }
 
 void store_scratchpad(Scratchpad *scratchpad, Addr offset, uint32_t val, AddrType type) {
+  mark_dirty(&scratchpad->dirty, offset.data);
+
   switch (type) {
     case AddrByte:
       store_scratchpad8(scratchpad, offset, val);
@@ -0,0 +1,16 @@
+lui 0x1 0x1234
+addiu 0x2 0x1 0x10
+addu 0x3 0x2 0x1
+addiu 0x4 0x3 0x7F
+addu 0x5 0x4 0x2
+lui 0x6 0x0f00
+addiu 0x7 0x6 0x1
+addu 0x8 0x7 0x5
+addiu 0x9 0x8 0x3
+addu 0xA 0x9 0x1
+addiu 0xB 0xA 0x2
+addu 0xC 0xB 0x3
+addiu 0xD 0xC 0x4
+addu 0xE 0xD 0x4
+j 0xbfc00000
+addiu 0xF 0xE 0x1
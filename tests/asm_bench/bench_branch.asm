@@ -0,0 +1,3 @@
+addiu 0x1 0x1 0x1
+j 0xbfc00000
+addiu 0x2 0x2 0x1
@@ -0,0 +1,14 @@
+lui 0x1 0x0000
+lw 0x2 0x1 0x0
+lw 0x3 0x1 0x4
+addu 0x4 0x2 0x3
+lw 0x5 0x1 0x8
+lw 0x6 0x1 0xC
+addu 0x7 0x5 0x6
+lw 0x8 0x1 0x10
+addu 0x9 0x8 0x4
+lw 0xA 0x1 0x14
+addu 0xB 0xA 0x7
+lw 0xC 0x1 0x18
+j 0xbfc00000
+addu 0xD 0xC 0x9
@@ -0,0 +1,3 @@
+beq 0x0 0x0 0x2
+nop
+lui 0x3 0x0BAD
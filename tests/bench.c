@@ -0,0 +1,295 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "context.h"
+#include "cpu.h"
+#include "flag.h"
+#include "raster.h"
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+// Each benchmark repeats its batch until this much time has passed
+#define BENCH_SECONDS 0.5
+#define MAX_RESULTS 32
+
+typedef struct BenchResult {
+  char const *name;
+  char const *unit;
+  double value;
+} BenchResult;
+
+static BenchResult results[MAX_RESULTS];
+static size_t result_count = 0;
+static Context ctx;
+
+static double now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void add_result(char const *name, char const *unit, double value) {
+  if (result_count >= MAX_RESULTS)
+    fatal("BenchError: Too many results");
+
+  results[result_count++] = (BenchResult) { name, unit, value };
+}
+
+static void bench_interpreter(char const *name, char const *bios_filename) {
+  Cpu cpu = init_cpu(&ctx, bios_filename);
+  uint64_t count = 0;
+
+  double start = now();
+  double elapsed;
+  do {
+    for (int i = 0; i < 100000; i++)
+      run_next_ins(&cpu);
+    count += 100000;
+    elapsed = now() - start;
+  } while (elapsed < BENCH_SECONDS);
+
+  add_result(name, "MIPS", count / elapsed / 1e6);
+  destroy_cpu(&cpu);
+}
+
+// `mask` wraps the offset so every access stays inside the region
+static void bench_bus(char const *name, Cpu *cpu, uint32_t base, uint32_t mask, bool write) {
+  uint64_t count = 0;
+  uint32_t sum = 0;
+
+  double start = now();
+  double elapsed;
+  do {
+    for (uint32_t i = 0; i < 100000; i++) {
+      Addr addr = MAKE_Addr(base + ((i << 2) & mask));
+      if (write)
+        store(&cpu->inter, &cpu->shared, addr, i, AddrWord);
+      else
+        sum += load(&cpu->inter, &cpu->shared, addr, AddrWord);
+    }
+    count += 100000;
+    elapsed = now() - start;
+  } while (elapsed < BENCH_SECONDS);
+
+  // Keeps the loads from being optimized out
+  if (sum == 0xFFFFFFFF)
+    log_trace("Bus checksum: %08X", sum);
+
+  add_result(name, "Mops", count / elapsed / 1e6);
+}
+
+static void set_full_drawing_area(Gpu *gpu) {
+  gpu_gp0(gpu, 0xE3000000);
+  gpu_gp0(gpu, 0xE4000000 | (511 << 10) | 1023);
+  gpu_gp0(gpu, 0xE5000000);
+}
+
+// "<prefix>.<suffix>", kept for the lifetime of the results
+static char const *result_name(char const *prefix, char const *suffix) {
+  size_t size = strlen(prefix) + strlen(suffix) + 2;
+  char *name = malloc(size);
+  if (name == NULL)
+    fatal("MemoryError: Couldn't allocate result name");
+
+  snprintf(name, size, "%s.%s", prefix, suffix);
+  return name;
+}
+
+// Gouraud shaded triangle covering half of a 256x256 square
+static void bench_tri(Gpu *gpu) {
+  uint64_t count = 0;
+
+  double start = now();
+  double elapsed;
+  do {
+    for (int i = 0; i < 100; i++) {
+      gpu_gp0(gpu, 0x300000FF);
+      gpu_gp0(gpu, (0 << 16) | 0);
+      gpu_gp0(gpu, 0x0000FF00);
+      gpu_gp0(gpu, (0 << 16) | 256);
+      gpu_gp0(gpu, 0x00FF0000);
+      gpu_gp0(gpu, (256 << 16) | 0);
+    }
+    count += 100;
+    elapsed = now() - start;
+  } while (elapsed < BENCH_SECONDS);
+
+  add_result(result_name("gpu.tri", gpu->renderer.kernels->name), "Mpixels/s", count * (256.0 * 256.0 / 2) / elapsed / 1e6);
+}
+
+// Blended 4 bit textured 256x256 quad, sampling from the top left of VRAM
+static void bench_textured_quad(Gpu *gpu) {
+  uint64_t count = 0;
+
+  double start = now();
+  double elapsed;
+  do {
+    for (int i = 0; i < 100; i++) {
+      gpu_gp0(gpu, 0x2C808080);
+      gpu_gp0(gpu, (0 << 16) | 512);
+      gpu_gp0(gpu, (0x4000 << 16) | 0x0000);
+      gpu_gp0(gpu, (0 << 16) | 768);
+      gpu_gp0(gpu, (0x0000 << 16) | 0x00FF);
+      gpu_gp0(gpu, (256 << 16) | 512);
+      gpu_gp0(gpu, 0xFF00);
+      gpu_gp0(gpu, (256 << 16) | 768);
+      gpu_gp0(gpu, 0xFFFF);
+    }
+    count += 100;
+    elapsed = now() - start;
+  } while (elapsed < BENCH_SECONDS);
+
+  add_result(result_name("gpu.textured_quad", gpu->renderer.kernels->name), "Mpixels/s", count * (256.0 * 256.0) / elapsed / 1e6);
+}
+
+// 256x256 GP0 fill rectangle
+static void bench_rect(Gpu *gpu) {
+  uint64_t count = 0;
+
+  double start = now();
+  double elapsed;
+  do {
+    for (int i = 0; i < 100; i++) {
+      gpu_gp0(gpu, 0x0200FF00);
+      gpu_gp0(gpu, (0 << 16) | 0);
+      gpu_gp0(gpu, (256 << 16) | 256);
+    }
+    count += 100;
+    elapsed = now() - start;
+  } while (elapsed < BENCH_SECONDS);
+
+  add_result(result_name("gpu.rect", gpu->renderer.kernels->name), "Mpixels/s", count * (256.0 * 256.0) / elapsed / 1e6);
+}
+
+// Halves of a 320x240 frame, Gouraud shaded and drawn over each other
+// SCENE_TRIS times. Through the render thread with `workers` tile
+// workers, or drawn in place.
+#define SCENE_TRIS 64
+
+static void bench_scene(Gpu *gpu, char const *suffix, bool threaded, uint32_t workers) {
+  if (threaded)
+    gpu_start_thread(gpu, workers);
+
+  uint64_t count = 0;
+
+  double start = now();
+  double elapsed;
+  do {
+    for (uint32_t i = 0; i < SCENE_TRIS; i += 2) {
+      gpu_gp0(gpu, 0x30000000 | (i * 0x030201));
+      gpu_gp0(gpu, (0 << 16) | 0);
+      gpu_gp0(gpu, 0x0000FF00);
+      gpu_gp0(gpu, (0 << 16) | 320);
+      gpu_gp0(gpu, 0x00FF0000);
+      gpu_gp0(gpu, (240 << 16) | 0);
+
+      gpu_gp0(gpu, 0x30FF0000);
+      gpu_gp0(gpu, (0 << 16) | 320);
+      gpu_gp0(gpu, 0x000000FF | (i << 8));
+      gpu_gp0(gpu, (240 << 16) | 320);
+      gpu_gp0(gpu, 0x0000FF00);
+      gpu_gp0(gpu, (240 << 16) | 0);
+    }
+    gpu_sync(gpu);
+    count += SCENE_TRIS;
+    elapsed = now() - start;
+  } while (elapsed < BENCH_SECONDS);
+
+  gpu_stop_thread(gpu);
+
+  add_result(result_name("gpu.scene", suffix), "Mpixels/s", count * (320.0 * 240.0 / 2) / elapsed / 1e6);
+}
+
+// GPU linked list of nodes carrying GP0 NOPs, walked by DMA channel 2
+#define DMA_LIST_BASE 0x10000
+#define DMA_LIST_NODES 1024
+#define DMA_NODE_WORDS 4
+
+static void bench_dma_linked_list(Cpu *cpu) {
+  uint32_t node_size = (DMA_NODE_WORDS + 1) * 4;
+
+  for (uint32_t i = 0; i < DMA_LIST_NODES; i++) {
+    uint32_t addr = DMA_LIST_BASE + i * node_size;
+    uint32_t next = (i + 1 < DMA_LIST_NODES) ? addr + node_size : 0xFFFFFF;
+    store(&cpu->inter, &cpu->shared, MAKE_Addr(addr), (DMA_NODE_WORDS << 24) | next, AddrWord);
+    for (uint32_t word = 1; word <= DMA_NODE_WORDS; word++)
+      store(&cpu->inter, &cpu->shared, MAKE_Addr(addr + word * 4), 0x00000000, AddrWord);
+  }
+
+  uint64_t count = 0;
+
+  double start = now();
+  double elapsed;
+  do {
+    store(&cpu->inter, &cpu->shared, MAKE_Addr(0x1F8010A0), DMA_LIST_BASE, AddrWord);
+    // From RAM, linked list sync, enabled
+    store(&cpu->inter, &cpu->shared, MAKE_Addr(0x1F8010A8), 0x01000401, AddrWord);
+    count++;
+    elapsed = now() - start;
+  } while (elapsed < BENCH_SECONDS);
+
+  add_result("dma.linked_list", "MB/s", count * DMA_LIST_NODES * node_size / elapsed / 1e6);
+}
+
+static void print_results() {
+  printf("{\n");
+  printf("  \"version\": \"%s\",\n", BENCH_VERSION);
+  printf("  \"results\": [\n");
+  for (size_t i = 0; i < result_count; i++) {
+    printf("    {\"name\": \"%s\", \"unit\": \"%s\", \"value\": %.3f}%s\n",
+      results[i].name, results[i].unit, results[i].value,
+      (i + 1 < result_count) ? "," : "");
+  }
+  printf("  ]\n");
+  printf("}\n");
+}
+
+int main(void) {
+  ctx = init_context();
+  set_flag(&ctx, HEADLESS);
+
+  bench_interpreter("interpreter.alu", "asm_bench/bench_alu.bin");
+  bench_interpreter("interpreter.load", "asm_bench/bench_load.bin");
+  bench_interpreter("interpreter.branch", "asm_bench/bench_branch.bin");
+
+  Cpu cpu = init_cpu(&ctx, "asm_bench/bench_alu.bin");
+
+  bench_bus("bus.ram.load", &cpu, 0x00000000, 0x1FFFFC, false);
+  bench_bus("bus.ram.store", &cpu, 0x00000000, 0x1FFFFC, true);
+  bench_bus("bus.ram_kseg1.load", &cpu, 0xA0000000, 0x1FFFFC, false);
+  bench_bus("bus.scratchpad.load", &cpu, 0x1F800000, 0x3FC, false);
+  bench_bus("bus.scratchpad.store", &cpu, 0x1F800000, 0x3FC, true);
+  bench_bus("bus.bios.load", &cpu, 0xBFC00000, 0x7FFFC, false);
+
+  set_full_drawing_area(&cpu.inter.gpu);
+  static char const *kernel_names[] = {"scalar", "sse2", "avx2"};
+  for (size_t i = 0; i < sizeof kernel_names / sizeof kernel_names[0]; i++) {
+    RasterKernels const *kernels = find_raster_kernels(kernel_names[i]);
+    if (kernels == NULL)
+      continue;
+
+    cpu.inter.gpu.renderer.kernels = kernels;
+    bench_tri(&cpu.inter.gpu);
+    bench_textured_quad(&cpu.inter.gpu);
+    bench_rect(&cpu.inter.gpu);
+  }
+  cpu.inter.gpu.renderer.kernels = select_raster_kernels();
+  bench_scene(&cpu.inter.gpu, "inline", false, 0);
+  bench_scene(&cpu.inter.gpu, "thread", true, 0);
+  bench_scene(&cpu.inter.gpu, "tiles_1", true, 1);
+  bench_scene(&cpu.inter.gpu, "tiles_3", true, 3);
+  bench_scene(&cpu.inter.gpu, "tiles_7", true, 7);
+  bench_dma_linked_list(&cpu);
+
+  destroy_cpu(&cpu);
+  destroy_context(&ctx);
+
+  print_results();
+
+  return 0;
+}
@@ -1,14 +1,23 @@
 #include "unity.h"
 #include "cpu.h"
+#include "flag.h"
+#include "raster.h"
+#include "savestate.h"
+#include "rewind.h"
+
+static Context ctx;
 
 void setUp(void) {
+  ctx = init_context();
+  set_flag(&ctx, HEADLESS);
 }
 
 void tearDown(void) {
+  destroy_context(&ctx);
 }
 
 void test_branch_delay_slot(void) {
-  Cpu cpu = init_cpu("asm_tests/test_branch_delay_slot.bin");
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
 
   run_next_ins(&cpu);
   run_next_ins(&cpu);
@@ -18,7 +27,7 @@ void test_branch_delay_slot(void) {
 }
 
 void test_load_delay_slot1(void) {
-  Cpu cpu = init_cpu("asm_tests/test_load_delay_slot1.bin");
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_load_delay_slot1.bin");
 
   run_next_ins(&cpu);
   run_next_ins(&cpu);
@@ -34,7 +43,7 @@ void test_load_delay_slot1(void) {
 }
 
 void test_load_delay_slot2(void) {
-  Cpu cpu = init_cpu("asm_tests/test_load_delay_slot2.bin");
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_load_delay_slot2.bin");
 
   run_next_ins(&cpu);
   run_next_ins(&cpu);
@@ -44,10 +53,505 @@ void test_load_delay_slot2(void) {
   TEST_ASSERT_EQUAL_UINT32(0x2A, cpu.regs[0x1]);
 }
 
+void test_code_cache_invalidation(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+
+  // addiu $2, $0, 0x1
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x0), 0x24020001, AddrWord);
+  cpu.pc = MAKE_Addr(0x0);
+  cpu.next_pc = MAKE_Addr(0x4);
+  run_next_ins(&cpu);
+
+  TEST_ASSERT_EQUAL_UINT32(0x1, cpu.regs[0x2]);
+
+  // addiu $2, $0, 0x2
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x0), 0x24020002, AddrWord);
+  cpu.pc = MAKE_Addr(0x0);
+  cpu.next_pc = MAKE_Addr(0x4);
+  run_next_ins(&cpu);
+
+  TEST_ASSERT_EQUAL_UINT32(0x2, cpu.regs[0x2]);
+
+  destroy_cpu(&cpu);
+}
+
+void test_icache_flush(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+  cpu.inter.icache.control = CACHE_CONTROL_ICACHE_ENABLE;
+
+  // addiu $2, $0, 0x1
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x0), 0x24020001, AddrWord);
+  cpu.pc = MAKE_Addr(0x80000000);
+  cpu.next_pc = MAKE_Addr(0x80000004);
+  run_next_ins(&cpu);
+
+  TEST_ASSERT_EQUAL_UINT32(0x1, cpu.regs[0x2]);
+
+  // addiu $2, $0, 0x2, written behind the CPU's back
+  cpu.inter.ram.data[0] = 0x02;
+  cpu.inter.icache.control |= CACHE_CONTROL_TAG_TEST;
+  icache_store(&cpu.inter.icache, &cpu.inter.code_cache, MAKE_Addr(0x0), 0x0);
+  cpu.pc = MAKE_Addr(0x80000000);
+  cpu.next_pc = MAKE_Addr(0x80000004);
+  run_next_ins(&cpu);
+
+  TEST_ASSERT_EQUAL_UINT32(0x2, cpu.regs[0x2]);
+
+  destroy_cpu(&cpu);
+}
+
+void test_ram_mirrors(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x80600010), 0x12345678, AddrWord);
+
+  TEST_ASSERT_EQUAL_UINT32(0x12345678, load(&cpu.inter, &cpu.shared, MAKE_Addr(0x00000010), AddrWord));
+  TEST_ASSERT_EQUAL_UINT32(0x12345678, load(&cpu.inter, &cpu.shared, MAKE_Addr(0xA0200010), AddrWord));
+  TEST_ASSERT_EQUAL_UINT32(0x12345678, load_ram(&cpu.inter.ram, MAKE_Addr(0x10), AddrWord));
+
+  destroy_cpu(&cpu);
+}
+
+void test_cpu_run(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+
+  Cycles ran = cpu_run(&cpu, MAKE_Cycles(2));
+
+  TEST_ASSERT_EQUAL_UINT64(2, ran.data);
+  TEST_ASSERT_EQUAL_UINT32(0xBFC04000, cpu.pc.data);
+  TEST_ASSERT_EQUAL_UINT32(0x0F000000, cpu.regs[0x12]);
+
+  destroy_cpu(&cpu);
+}
+
+void test_idle_loop(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x100), 0x0, AddrWord);
+  // lw $1, 0x100($0); nop; beq $1, $0, -3; nop
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x0), 0x8C010100, AddrWord);
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x4), 0x00000000, AddrWord);
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x8), 0x1020FFFD, AddrWord);
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0xC), 0x00000000, AddrWord);
+  cpu.pc = MAKE_Addr(0x0);
+  cpu.next_pc = MAKE_Addr(0x4);
+
+  // Only finishes if the loop gets fast-forwarded
+  Cycles budget = MAKE_Cycles(1ULL << 40);
+  Cycles ran = cpu_run(&cpu, budget);
+
+  TEST_ASSERT_EQUAL_UINT64(budget.data, ran.data);
+  TEST_ASSERT_LESS_THAN_UINT32(0x10, cpu.pc.data);
+
+  destroy_cpu(&cpu);
+}
+
+void test_hle_memcpy(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x200), 0x04030201, AddrWord);
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x300), 0x0, AddrWord);
+  cpu.regs[4] = 0x300;
+  cpu.regs[5] = 0x200;
+  cpu.regs[6] = 4;
+  cpu.regs[9] = 0x2A;
+  cpu.regs[31] = 0x1000;
+  cpu.pc = MAKE_Addr(HLE_A0_PC);
+  cpu.next_pc = MAKE_Addr(HLE_A0_PC + 4);
+
+  run_next_ins(&cpu);
+
+  TEST_ASSERT_EQUAL_UINT32(0x1000, cpu.pc.data);
+  TEST_ASSERT_EQUAL_UINT32(0x300, cpu.regs[2]);
+  TEST_ASSERT_EQUAL_HEX32(0x04030201, load(&cpu.inter, &cpu.shared, MAKE_Addr(0x300), AddrWord));
+
+  hle_set_enabled(&cpu.hle, HleA0, 0x2A, false);
+  TEST_ASSERT_FALSE(hle_call(&cpu, HleA0));
+
+  destroy_cpu(&cpu);
+}
+
+void test_save_state(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+
+  cpu.pc = MAKE_Addr(SIDELOAD_HOOK_PC);
+  cpu.regs[5] = 0x12345678;
+  cpu.shared.clock.now = MAKE_Cycles(1000);
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x100), 0xCAFEBABE, AddrWord);
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x1F800010), 0xDEADBEEF, AddrWord);
+  *get_vram(&cpu.inter.gpu.renderer, 10, 20) = 0x7FFF;
+  TEST_ASSERT_TRUE(save_state(&cpu, "test.state"));
+
+  Cpu restored = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+  TEST_ASSERT_TRUE(load_state(&restored, "test.state"));
+  TEST_ASSERT_EQUAL_HEX32(SIDELOAD_HOOK_PC, restored.pc.data);
+  TEST_ASSERT_EQUAL_HEX32(0x12345678, restored.regs[5]);
+  TEST_ASSERT_EQUAL_UINT64(1000, restored.shared.clock.now.data);
+  TEST_ASSERT_EQUAL_HEX32(0xCAFEBABE, load(&restored.inter, &restored.shared, MAKE_Addr(0x100), AddrWord));
+  TEST_ASSERT_EQUAL_HEX32(0xDEADBEEF, load(&restored.inter, &restored.shared, MAKE_Addr(0x1F800010), AddrWord));
+  TEST_ASSERT_EQUAL_HEX16(0x7FFF, *get_vram(&restored.inter.gpu.renderer, 10, 20));
+
+  // States only load with the BIOS they were made with
+  restored.inter.bios.data[0] ^= 0xFF;
+  TEST_ASSERT_FALSE(load_state(&restored, "test.state"));
+
+  remove("test.state");
+  destroy_cpu(&restored);
+  destroy_cpu(&cpu);
+}
+
+void test_snapshot(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x100), 0x11111111, AddrWord);
+  Snapshot snapshot = init_snapshot(&cpu);
+
+  // Only the page written since the last update gets copied
+  TEST_ASSERT_EQUAL_UINT32(0, snapshot_update(&snapshot, &cpu));
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x100), 0x22222222, AddrWord);
+  TEST_ASSERT_TRUE(page_dirty(&cpu.inter.ram.dirty, 0));
+  TEST_ASSERT_EQUAL_UINT32(1, snapshot_update(&snapshot, &cpu));
+
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x100), 0x33333333, AddrWord);
+  cpu.regs[5] = 0x12345678;
+  snapshot_restore(&snapshot, &cpu);
+
+  TEST_ASSERT_EQUAL_HEX32(0x22222222, load(&cpu.inter, &cpu.shared, MAKE_Addr(0x100), AddrWord));
+  TEST_ASSERT_NOT_EQUAL(0x12345678, cpu.regs[5]);
+  TEST_ASSERT_FALSE(page_dirty(&cpu.inter.ram.dirty, 0));
+
+  destroy_snapshot(&snapshot);
+  destroy_cpu(&cpu);
+}
+
+void test_rewind(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+  Rewind rewind;
+  init_rewind(&rewind, &cpu, 8, REWIND_DEFAULT_MEMORY_CAP);
+
+  // More captures than fit, so the oldest keyframe group gets evicted
+  for (uint32_t frame = 0; frame < 12; frame++) {
+    store(&cpu.inter, &cpu.shared, MAKE_Addr(0x100), frame, AddrWord);
+    cpu.regs[5] = frame;
+    rewind_capture(&rewind, &cpu);
+    // Let the worker keep up so no capture gets dropped
+    rewind_count(&rewind);
+  }
+
+  uint32_t count = rewind_count(&rewind);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(8, count);
+  TEST_ASSERT_GREATER_THAN_UINT32(2, count);
+
+  TEST_ASSERT_TRUE(rewind_restore(&rewind, &cpu, 2));
+  TEST_ASSERT_EQUAL_UINT32(9, load(&cpu.inter, &cpu.shared, MAKE_Addr(0x100), AddrWord));
+  TEST_ASSERT_EQUAL_UINT32(9, cpu.regs[5]);
+  TEST_ASSERT_EQUAL_UINT32(count - 2, rewind_count(&rewind));
+  TEST_ASSERT_FALSE(rewind_restore(&rewind, &cpu, count));
+
+  destroy_rewind(&rewind);
+  destroy_cpu(&cpu);
+}
+
+void test_headless(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+  GpuRenderer *renderer = &cpu.inter.gpu.renderer;
+
+  TEST_ASSERT_NULL(renderer->window);
+
+  // GP0 0x68: 1x1 white rectangle at (10, 20)
+  gpu_gp0(&cpu.inter.gpu, 0x68FFFFFF);
+  gpu_gp0(&cpu.inter.gpu, (20 << 16) | 10);
+  TEST_ASSERT_EQUAL_HEX16(0x7FFF, *get_vram(renderer, 10, 20));
+
+  destroy_cpu(&cpu);
+}
+
+void test_tri_fill_rule(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+  Gpu *gpu = &cpu.inter.gpu;
+
+  gpu_gp0(gpu, 0xE3000000);
+  gpu_gp0(gpu, 0xE4000000 | (511 << 10) | 1023);
+  // GP0 0x28: white 4x4 quad at (8, 8), drawn as two triangles
+  gpu_gp0(gpu, 0x28FFFFFF);
+  gpu_gp0(gpu, (8 << 16) | 8);
+  gpu_gp0(gpu, (8 << 16) | 12);
+  gpu_gp0(gpu, (12 << 16) | 8);
+  gpu_gp0(gpu, (12 << 16) | 12);
+
+  // Top and left edges are drawn, right and bottom edges aren't
+  for (uint16_t y = 7; y <= 12; y++) {
+    for (uint16_t x = 7; x <= 12; x++) {
+      bool inside = x >= 8 && x < 12 && y >= 8 && y < 12;
+      TEST_ASSERT_EQUAL_HEX16(inside ? 0x7FFF : 0x0, *get_vram(&gpu->renderer, x, y));
+    }
+  }
+
+  destroy_cpu(&cpu);
+}
+
+static void draw_shaded_tri(Gpu *gpu) {
+  memset(gpu->renderer.vram, 0, VRAM_WIDTH * VRAM_HEIGHT * sizeof(uint16_t));
+  gpu_gp0(gpu, 0xE3000000);
+  gpu_gp0(gpu, 0xE4000000 | (511 << 10) | 1023);
+  gpu_gp0(gpu, 0x300000FF);
+  gpu_gp0(gpu, (3 << 16) | 5);
+  gpu_gp0(gpu, 0x0000FF00);
+  gpu_gp0(gpu, (40 << 16) | 97);
+  gpu_gp0(gpu, 0x00FF0000);
+  gpu_gp0(gpu, (77 << 16) | 21);
+}
+
+// Drawn after draw_shaded_tri, from a 15 bit texture at x = 512 with
+// some black, transparent texels
+static void draw_textured_prims(Gpu *gpu) {
+  for (uint32_t y = 0; y < 256; y++) {
+    for (uint32_t x = 0; x < 256; x++) {
+      uint16_t texel = (x * 37 + y * 91) & 0xFFFF;
+      gpu->renderer.vram[y * VRAM_WIDTH + 512 + x] = ((x ^ y) % 7 == 0) ? 0 : texel;
+    }
+  }
+
+  // GP0 0x28: Background for the transparent texels
+  gpu_gp0(gpu, 0x28406080);
+  gpu_gp0(gpu, (85 << 16) | 0);
+  gpu_gp0(gpu, (85 << 16) | 400);
+  gpu_gp0(gpu, (265 << 16) | 0);
+  gpu_gp0(gpu, (265 << 16) | 400);
+
+  // GP0 0x2C: Blended textured quad
+  gpu_gp0(gpu, 0x2C60A0E0);
+  gpu_gp0(gpu, (100 << 16) | 20);
+  gpu_gp0(gpu, 0x00000305);
+  gpu_gp0(gpu, (90 << 16) | 210);
+  gpu_gp0(gpu, (0x0108 << 16) | 0x10F0);
+  gpu_gp0(gpu, (250 << 16) | 35);
+  gpu_gp0(gpu, 0xE80A);
+  gpu_gp0(gpu, (240 << 16) | 190);
+  gpu_gp0(gpu, 0xF0E0);
+
+  // GP0 0x64: Textured rect from the same page
+  gpu_gp0(gpu, 0xE1000000 | (2 << 7) | 8);
+  gpu_gp0(gpu, 0x64FFFFFF);
+  gpu_gp0(gpu, (40 << 16) | 220);
+  gpu_gp0(gpu, 0x00002111);
+  gpu_gp0(gpu, (90 << 16) | 150);
+}
+
+void test_raster_kernels_match(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+  Gpu *gpu = &cpu.inter.gpu;
+  size_t size = VRAM_WIDTH * VRAM_HEIGHT * sizeof(uint16_t);
+  uint16_t *expected = malloc(size);
+
+  gpu->renderer.kernels = find_raster_kernels("scalar");
+  draw_shaded_tri(gpu);
+  draw_textured_prims(gpu);
+  memcpy(expected, gpu->renderer.vram, size);
+
+  char const *names[] = {"sse2", "avx2"};
+  for (int i = 0; i < 2; i++) {
+    gpu->renderer.kernels = find_raster_kernels(names[i]);
+    if (gpu->renderer.kernels == NULL)
+      continue;
+    draw_shaded_tri(gpu);
+    draw_textured_prims(gpu);
+    TEST_ASSERT_EQUAL_MEMORY(expected, gpu->renderer.vram, size);
+  }
+
+  free(expected);
+  destroy_cpu(&cpu);
+}
+
+void test_gpu_thread(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+  Gpu *gpu = &cpu.inter.gpu;
+  size_t size = VRAM_WIDTH * VRAM_HEIGHT * sizeof(uint16_t);
+  uint16_t *expected = malloc(size);
+
+  draw_shaded_tri(gpu);
+  memcpy(expected, gpu->renderer.vram, size);
+
+  gpu_start_thread(gpu, 0);
+  draw_shaded_tri(gpu);
+  gpu_sync(gpu);
+  TEST_ASSERT_EQUAL_MEMORY(expected, gpu->renderer.vram, size);
+
+  // GP0 0xC0: Copy 2x1 pixels at (40, 20) to the CPU. GPUREAD has to
+  // wait for the render thread.
+  gpu_gp0(gpu, 0xC0000000);
+  gpu_gp0(gpu, (20 << 16) | 40);
+  gpu_gp0(gpu, (1 << 16) | 2);
+  uint32_t pixels = *get_vram(&gpu->renderer, 40, 20) | (*get_vram(&gpu->renderer, 41, 20) << 16);
+  TEST_ASSERT_EQUAL_HEX32(pixels, gpu_read(gpu));
+
+  free(expected);
+  destroy_cpu(&cpu);
+}
+
+// Overlapping triangles, then a quad textured with what they drew, an
+// image load and a dot
+static void draw_tile_scene(Gpu *gpu) {
+  memset(gpu->renderer.vram, 0, VRAM_WIDTH * VRAM_HEIGHT * sizeof(uint16_t));
+  gpu_gp0(gpu, 0xE3000000);
+  gpu_gp0(gpu, 0xE4000000 | (511 << 10) | 1023);
+  for (uint32_t i = 0; i < 64; i++) {
+    gpu_gp0(gpu, 0x30000000 | (i * 0x040404));
+    gpu_gp0(gpu, (i << 16) | (i * 3));
+    gpu_gp0(gpu, 0x0000FF00);
+    gpu_gp0(gpu, ((200 - i) << 16) | 150);
+    gpu_gp0(gpu, 0x00FF0000);
+    gpu_gp0(gpu, ((i * 2) << 16) | (250 - i));
+  }
+
+  // GP0 0x2C: 15 bit texture from the top left of VRAM
+  gpu_gp0(gpu, 0x2C808080);
+  gpu_gp0(gpu, (300 << 16) | 300);
+  gpu_gp0(gpu, 0x00000000);
+  gpu_gp0(gpu, (300 << 16) | 400);
+  gpu_gp0(gpu, (0x0100 << 16) | 0x00FF);
+  gpu_gp0(gpu, (400 << 16) | 300);
+  gpu_gp0(gpu, 0xFF00);
+  gpu_gp0(gpu, (400 << 16) | 400);
+  gpu_gp0(gpu, 0xFFFF);
+
+  // GP0 0xA0: 2x2 image over the triangles
+  gpu_gp0(gpu, 0xA0000000);
+  gpu_gp0(gpu, (50 << 16) | 50);
+  gpu_gp0(gpu, (2 << 16) | 2);
+  gpu_gp0(gpu, 0x7FFF001F);
+  gpu_gp0(gpu, 0x03E07C00);
+
+  // GP0 0x68: Dot over the image
+  gpu_gp0(gpu, 0x68FFFFFF);
+  gpu_gp0(gpu, (50 << 16) | 50);
+}
+
+void test_gpu_tiles(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+  Gpu *gpu = &cpu.inter.gpu;
+  size_t size = VRAM_WIDTH * VRAM_HEIGHT * sizeof(uint16_t);
+  uint16_t *expected = malloc(size);
+
+  draw_tile_scene(gpu);
+  memcpy(expected, gpu->renderer.vram, size);
+
+  gpu_start_thread(gpu, 3);
+  draw_tile_scene(gpu);
+  gpu_sync(gpu);
+  TEST_ASSERT_EQUAL_MEMORY(expected, gpu->renderer.vram, size);
+
+  free(expected);
+  destroy_cpu(&cpu);
+}
+
+void test_jit_branch_delay_slot(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+
+  run_next_block(&cpu);
+
+  TEST_ASSERT_EQUAL_UINT32(0xBFC04000, cpu.pc.data);
+  TEST_ASSERT_EQUAL_UINT32(cpu.regs[0x12], 0x0F000000);
+
+  destroy_cpu(&cpu);
+}
+
+void test_jit_taken_branch(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_jit_taken_branch.bin");
+  uint32_t prev_value = cpu.regs[0x3];
+
+  run_next_block(&cpu);
+
+  TEST_ASSERT_EQUAL_UINT32(0xBFC0000C, cpu.pc.data);
+  TEST_ASSERT_EQUAL_UINT32(prev_value, cpu.regs[0x3]);
+
+  destroy_cpu(&cpu);
+}
+
+void test_jit_load_delay_slot(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_load_delay_slot1.bin");
+  uint32_t prev_value = cpu.regs[0x1];
+
+  run_next_block(&cpu);
+
+  TEST_ASSERT_EQUAL_UINT32(0x0F120000, cpu.regs[0x2]);
+  TEST_ASSERT_NOT_EQUAL(prev_value, cpu.regs[0x3]);
+  TEST_ASSERT_EQUAL_UINT32(cpu.regs[0x1], cpu.regs[0x3]);
+
+  destroy_cpu(&cpu);
+}
+
+void test_jit_invalidation(void) {
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+
+  // j 0x0; nop
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x4), 0x08000000, AddrWord);
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x8), 0x00000000, AddrWord);
+  // addiu $2, $0, 0x1
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x0), 0x24020001, AddrWord);
+  cpu.pc = MAKE_Addr(0x0);
+  cpu.next_pc = MAKE_Addr(0x4);
+  run_next_block(&cpu);
+
+  TEST_ASSERT_EQUAL_UINT32(0x1, cpu.regs[0x2]);
+
+  // addiu $2, $0, 0x2
+  store(&cpu.inter, &cpu.shared, MAKE_Addr(0x0), 0x24020002, AddrWord);
+  cpu.pc = MAKE_Addr(0x0);
+  cpu.next_pc = MAKE_Addr(0x4);
+  run_next_block(&cpu);
+
+  TEST_ASSERT_EQUAL_UINT32(0x2, cpu.regs[0x2]);
+
+  destroy_cpu(&cpu);
+}
+
+void test_independent_contexts(void) {
+  Context other = init_context();
+  set_flag(&other, HEADLESS);
+  set_flag(&other, CPU_JIT);
+  set_rom_filename(&other, "other.exe");
+
+  Cpu cpu = init_cpu(&ctx, "asm_tests/test_branch_delay_slot.bin");
+  Cpu other_cpu = init_cpu(&other, "asm_tests/test_branch_delay_slot.bin");
+
+  TEST_ASSERT_TRUE(cpu.inter.gpu.ctx == &ctx);
+  TEST_ASSERT_TRUE(other_cpu.inter.gpu.ctx == &other);
+  TEST_ASSERT_FALSE(get_flag(cpu.ctx, CPU_JIT));
+  TEST_ASSERT_TRUE(get_flag(other_cpu.ctx, CPU_JIT));
+  TEST_ASSERT_EQUAL_STRING("", get_rom_filename(cpu.ctx));
+  TEST_ASSERT_EQUAL_STRING("other.exe", get_rom_filename(other_cpu.ctx));
+
+  destroy_cpu(&other_cpu);
+  destroy_cpu(&cpu);
+  destroy_context(&other);
+}
+
 int main(void) {
   UNITY_BEGIN();
   RUN_TEST(test_branch_delay_slot);
   RUN_TEST(test_load_delay_slot1);
   RUN_TEST(test_load_delay_slot2);
+  RUN_TEST(test_code_cache_invalidation);
+  RUN_TEST(test_icache_flush);
+  RUN_TEST(test_ram_mirrors);
+  RUN_TEST(test_cpu_run);
+  RUN_TEST(test_idle_loop);
+  RUN_TEST(test_hle_memcpy);
+  RUN_TEST(test_save_state);
+  RUN_TEST(test_snapshot);
+  RUN_TEST(test_rewind);
+  RUN_TEST(test_headless);
+  RUN_TEST(test_tri_fill_rule);
+  RUN_TEST(test_raster_kernels_match);
+  RUN_TEST(test_gpu_thread);
+  RUN_TEST(test_gpu_tiles);
+  if (jit_supported()) {
+    RUN_TEST(test_jit_branch_delay_slot);
+    RUN_TEST(test_jit_taken_branch);
+    RUN_TEST(test_jit_load_delay_slot);
+    RUN_TEST(test_jit_invalidation);
+  }
+  RUN_TEST(test_independent_contexts);
   return UNITY_END();
 }
@@ -59,12 +59,19 @@ void assemble_tokens(char **tokens, size_t token_count, FILE * const fp_output)
     uint32_t rd = strtol(tokens[1], 0, 0) << 11;
     uint32_t rt = strtol(tokens[2], 0, 0) << 16;
     uint32_t rs = strtol(tokens[3], 0, 0) << 21;
-    ins = rs | rt | rd | 0x03000021;
+    ins = rs | rt | rd | 0x00000021;
   } else if (strcmp(tokens[0], "addiu") == 0) {
+    uint32_t rt = strtol(tokens[1], 0, 0) << 16;
+    uint32_t rs = strtol(tokens[2], 0, 0) << 21;
+    uint32_t imm_se = strtol(tokens[3], 0, 0) & 0xFFFF;
+    ins = rs | rt | imm_se | 0x24000000; 
+  } else if (strcmp(tokens[0], "beq") == 0) {
     uint32_t rs = strtol(tokens[1], 0, 0) << 21;
     uint32_t rt = strtol(tokens[2], 0, 0) << 16;
     uint32_t imm_se = strtol(tokens[3], 0, 0) & 0xFFFF;
-    ins = rs | rt | imm_se | 0x24000000; 
+    ins = rs | rt | imm_se | 0x10000000;
+  } else if (strcmp(tokens[0], "nop") == 0) {
+    ins = 0x00000000;
   } else {
     fatal("AssemblerError: Could not match test instruction. Instruction Token: %s", tokens[0]);
   }
@@ -102,9 +109,10 @@ void assemble_test(char const* input, char const* output) {
   fclose(fp_output);
 }
 
-int main(void) {
+int main(int argc, char **argv) {
   dirent *dir_entry;
-  DIR * const dir = opendir("asm_tests");
+  char const *dir_name = (argc > 1) ? argv[1] : "asm_tests";
+  DIR * const dir = opendir(dir_name);
 
   if (dir) {
     while ((dir_entry = readdir(dir))) {
@@ -112,14 +120,11 @@ int main(void) {
         char *ptr = strstr(dir_entry->d_name, ".asm");
 
         if (ptr) {
-          size_t filename_length = strlen(dir_entry->d_name) + 10;
+          size_t filename_length = strlen(dir_name) + 1 + strlen(dir_entry->d_name);
           char input_file[filename_length + 1];
           char output_file[filename_length + 1];
-          strncpy(input_file, "asm_tests/", 11);
-          strncpy(input_file + 10, dir_entry->d_name, filename_length - 10);
-          strncpy(output_file, "asm_tests/", 11);
-          strncpy(output_file + 10, dir_entry->d_name, filename_length - 10);
-          input_file[filename_length] = output_file[filename_length] = 0;
+          snprintf(input_file, sizeof input_file, "%s/%s", dir_name, dir_entry->d_name);
+          strcpy(output_file, input_file);
 
           size_t index = filename_length - 3;
           output_file[index++] = 'b';